@@ -1,3 +1,5 @@
 #include "platform_timing.c"
+#include "latency_histogram.c"
+#include "benchmark_results.c"
 #include "profile.c"
 #include "repetition_test.c"
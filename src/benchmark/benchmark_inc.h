@@ -2,6 +2,8 @@
 #define BENCHMARK_INC_H
 
 #include "platform_timing.h"
+#include "latency_histogram.h"
+#include "benchmark_results.h"
 #include "profile.h"
 #include "repetition_test.h"
 
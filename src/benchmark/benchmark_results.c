@@ -0,0 +1,101 @@
+#include "benchmark_results.h"
+
+#define BENCHMARK_RESULTS_FIXED_COLUMNS 8
+
+static
+FILE *benchmark_results_open(String path)
+{
+  char name[4096] = {0};
+  MEM_COPY(name, path.v, MIN(path.count, sizeof(name) - 1));
+
+  FILE *file = fopen(name, "ab");
+  if (!file)
+  {
+    LOG_ERROR("Unable to open '%.*s' for writing benchmark results", String_Format(path));
+    return NULL;
+  }
+
+  fseek(file, 0, SEEK_END);
+  if (ftell(file) == 0)
+  {
+    fprintf(file, "kind,name,count,min_cycles,avg_cycles,max_cycles,bytes,timer_frequency");
+    for (usize i = 0; i < PERF_COUNTER_COUNT; i++)
+    {
+      fprintf(file, ",");
+      for (const char *c = perf_counter_name(i); *c; c++)
+      {
+        fputc(*c == ' ' ? '_' : *c, file);
+      }
+    }
+    fprintf(file, "\n");
+  }
+
+  return file;
+}
+
+static
+void benchmark_results_write(FILE *file, Benchmark_Record *record)
+{
+  fprintf(file, "%.*s,", String_Format(record->kind));
+  for (usize i = 0; i < record->name.count; i++)
+  {
+    u8 c = record->name.v[i];
+    fputc((c == ',' || c == '"' || c == '\n' || c == '\r') ? '_' : c, file);
+  }
+
+  fprintf(file, ",%lu,%lu,%lu,%lu,%lu,%lu", record->count, record->min_cycles, record->avg_cycles, record->max_cycles,
+          record->bytes, record->cpu_timer_frequency);
+  for (usize i = 0; i < PERF_COUNTER_COUNT; i++)
+  {
+    fprintf(file, ",%lu", record->counters[i]);
+  }
+  fprintf(file, "\n");
+}
+
+static
+b32 benchmark_results_parse(String line, Benchmark_Record *record)
+{
+  ZERO_STRUCT(record);
+
+  line = string_trim_whitespace(line);
+  if (!line.count || string_starts_with(line, String("kind,")))
+  {
+    return false;
+  }
+
+  String fields[BENCHMARK_RESULTS_FIXED_COLUMNS + PERF_COUNTER_COUNT] = {0};
+  usize field_count = 0;
+
+  usize field_start = 0;
+  for (usize i = 0; i <= line.count && field_count < STATIC_COUNT(fields); i++)
+  {
+    if (i == line.count || line.v[i] == ',')
+    {
+      fields[field_count] = string_substring(line, field_start, i);
+      field_count += 1;
+      field_start = i + 1;
+    }
+  }
+
+  // Counters are optional, older files or other machines might have fewer
+  if (field_count < BENCHMARK_RESULTS_FIXED_COLUMNS)
+  {
+    return false;
+  }
+
+  record->kind                = fields[0];
+  record->name                = fields[1];
+  record->count               = string_to_u64(fields[2]);
+  record->min_cycles          = string_to_u64(fields[3]);
+  record->avg_cycles          = string_to_u64(fields[4]);
+  record->max_cycles          = string_to_u64(fields[5]);
+  record->bytes               = string_to_u64(fields[6]);
+  record->cpu_timer_frequency = string_to_u64(fields[7]);
+
+  for (usize i = BENCHMARK_RESULTS_FIXED_COLUMNS; i < field_count; i++)
+  {
+    record->counters[i - BENCHMARK_RESULTS_FIXED_COLUMNS] = string_to_u64(fields[i]);
+  }
+
+  return true;
+}
@@ -0,0 +1,38 @@
+#ifndef BENCHMARK_RESULTS_H
+#define BENCHMARK_RESULTS_H
+
+#include "../common.h"
+#include "platform_timing.h"
+
+// One csv line per profile zone or repetition test, files get appended to so a few runs of the same
+// thing can go in one file and the spread between them shows up in benchmark_compare:
+//
+//   kind,name,count,min_cycles,avg_cycles,max_cycles,bytes,timer_frequency,cycles,instructions,...
+//
+// Commas, quotes and newlines in names get written as '_'
+typedef struct Benchmark_Record Benchmark_Record;
+struct Benchmark_Record
+{
+  String kind;       // "zone" or "test"
+  String name;
+  u64    count;      // Zone hits, or tests run
+  u64    min_cycles; // Zones are one inclusive measurement, so all three are the same
+  u64    avg_cycles;
+  u64    max_cycles;
+  u64    bytes;
+  u64    cpu_timer_frequency;
+  u64    counters[PERF_COUNTER_COUNT]; // 0 without counters, for tests these are from the min run
+};
+
+// Appends, and writes the header if the file is new. NULL if it can't be opened
+static
+FILE *benchmark_results_open(String path);
+
+static
+void benchmark_results_write(FILE *file, Benchmark_Record *record);
+
+// Strings in the record point into the line. False for the header and anything malformed
+static
+b32 benchmark_results_parse(String line, Benchmark_Record *record);
+
+#endif // BENCHMARK_RESULTS_H
@@ -0,0 +1,94 @@
+#include "latency_histogram.h"
+
+static inline
+usize latency_histogram_bucket(u64 value)
+{
+  usize result = 0;
+
+  if (value < LATENCY_HISTOGRAM_SUB_COUNT)
+  {
+    result = value;
+  }
+  else
+  {
+    usize top_bit = 63 - __builtin_clzll(value);
+    if (top_bit >= LATENCY_HISTOGRAM_MAX_BITS)
+    {
+      result = LATENCY_HISTOGRAM_BUCKET_COUNT - 1;
+    }
+    else
+    {
+      usize shift = top_bit - LATENCY_HISTOGRAM_SUB_BITS;
+      usize sub   = (value >> shift) & (LATENCY_HISTOGRAM_SUB_COUNT - 1);
+
+      result = LATENCY_HISTOGRAM_SUB_COUNT + shift * LATENCY_HISTOGRAM_SUB_COUNT + sub;
+    }
+  }
+
+  return result;
+}
+
+static inline
+void latency_histogram_add(Latency_Histogram *histogram, u64 value)
+{
+  histogram->buckets[latency_histogram_bucket(value)] += 1;
+  histogram->count += 1;
+}
+
+static
+void latency_histogram_merge(Latency_Histogram *into, Latency_Histogram *from)
+{
+  for (usize i = 0; i < LATENCY_HISTOGRAM_BUCKET_COUNT; i++)
+  {
+    into->buckets[i] += from->buckets[i];
+  }
+  into->count += from->count;
+}
+
+static
+u64 latency_histogram_percentile(Latency_Histogram *histogram, f64 percentile)
+{
+  u64 result = 0;
+
+  if (histogram->count)
+  {
+    // Smallest bucket that has at least this many at or below it, and always at least the first
+    u64 wanted = (u64)((percentile / 100.0) * (f64)histogram->count + 0.5);
+    wanted = CLAMP(wanted, 1, histogram->count);
+
+    u64 seen = 0;
+    for (usize i = 0; i < LATENCY_HISTOGRAM_BUCKET_COUNT; i++)
+    {
+      seen += histogram->buckets[i];
+      if (seen >= wanted)
+      {
+        if (i < LATENCY_HISTOGRAM_SUB_COUNT)
+        {
+          result = i;
+        }
+        else
+        {
+          usize shift = (i - LATENCY_HISTOGRAM_SUB_COUNT) / LATENCY_HISTOGRAM_SUB_COUNT;
+          usize sub   = (i - LATENCY_HISTOGRAM_SUB_COUNT) % LATENCY_HISTOGRAM_SUB_COUNT;
+
+          u64 lower = (u64)(LATENCY_HISTOGRAM_SUB_COUNT + sub) << shift;
+          u64 width = 1ull << shift;
+          result = lower + width / 2;
+        }
+        break;
+      }
+    }
+  }
+
+  return result;
+}
+
+static
+void print_latency_histogram_percentiles(const char *prefix, Latency_Histogram *histogram)
+{
+  printf("%sp50: %lu, p90: %lu, p99: %lu, p99.9: %lu", prefix,
+         latency_histogram_percentile(histogram, 50.0),
+         latency_histogram_percentile(histogram, 90.0),
+         latency_histogram_percentile(histogram, 99.0),
+         latency_histogram_percentile(histogram, 99.9));
+}
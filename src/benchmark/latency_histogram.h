@@ -0,0 +1,36 @@
+#ifndef LATENCY_HISTOGRAM_H
+#define LATENCY_HISTOGRAM_H
+
+#include "../common.h"
+
+// HDR style log-linear buckets over cycle counts. Values under LATENCY_HISTOGRAM_SUB_COUNT get a
+// bucket each, after that every power of 2 is split into LATENCY_HISTOGRAM_SUB_COUNT linear buckets,
+// so any reported value is within 1 / (2 * LATENCY_HISTOGRAM_SUB_COUNT) (~3%) of the real one.
+// Fixed size, adding is just a clz and an increment
+#define LATENCY_HISTOGRAM_SUB_BITS     4
+#define LATENCY_HISTOGRAM_SUB_COUNT    (1 << LATENCY_HISTOGRAM_SUB_BITS)
+#define LATENCY_HISTOGRAM_MAX_BITS     40 // 2^40 cycles and up (minutes) all land in the last bucket
+#define LATENCY_HISTOGRAM_BUCKET_COUNT (LATENCY_HISTOGRAM_SUB_COUNT + (LATENCY_HISTOGRAM_MAX_BITS - LATENCY_HISTOGRAM_SUB_BITS) * LATENCY_HISTOGRAM_SUB_COUNT)
+
+typedef struct Latency_Histogram Latency_Histogram;
+struct Latency_Histogram
+{
+  u64 count;
+  u32 buckets[LATENCY_HISTOGRAM_BUCKET_COUNT];
+};
+
+static inline
+void latency_histogram_add(Latency_Histogram *histogram, u64 value);
+
+static
+void latency_histogram_merge(Latency_Histogram *into, Latency_Histogram *from);
+
+// percentile in [0, 100], gives back the middle of the bucket it lands in. 0 if empty
+static
+u64 latency_histogram_percentile(Latency_Histogram *histogram, f64 percentile);
+
+// '[prefix]p50: N, p90: N, p99: N, p99.9: N', no newline
+static
+void print_latency_histogram_percentiles(const char *prefix, Latency_Histogram *histogram);
+
+#endif // LATENCY_HISTOGRAM_H
@@ -62,6 +62,7 @@ f64 cpu_time_in_seconds(u64 cpu_time, u64 cpu_timer_frequency)
 #include <linux/perf_event.h>
 #include <sys/syscall.h>
 #include <unistd.h>
+#include <errno.h>
 
 static
 u64 read_os_page_faults(void)
@@ -95,14 +96,241 @@ u64 read_os_timer(void)
   return result;
 }
 
+#include <sys/ioctl.h>
+#include <sys/mman.h>
 
-// static inline
-// long perf_event_open(struct perf_event_attr *hw_event, pid_t pid,
-//                      int cpu, int group_fd, unsigned long flags)
-// {
-//   // NOTE: Sometimes a system's linux headers might not have '__NR_perf_event_open' ...
-//   return syscall(__NR_perf_event_open, hw_event, pid, cpu, group_fd, flags);
-// }
+static inline
+long perf_event_open(struct perf_event_attr *hw_event, pid_t pid,
+                     int cpu, int group_fd, unsigned long flags)
+{
+  // NOTE: Sometimes a system's linux headers might not have '__NR_perf_event_open' ...
+  return syscall(__NR_perf_event_open, hw_event, pid, cpu, group_fd, flags);
+}
+
+#define PERF_CACHE_READ_MISS(cache) ((cache) | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16))
+
+typedef struct Perf_Counter_Spec Perf_Counter_Spec;
+struct Perf_Counter_Spec
+{
+  u32 type;
+  u64 config;
+};
+
+static Perf_Counter_Spec perf_counter_specs[PERF_COUNTER_COUNT] =
+{
+  [PERF_COUNTER_CYCLES]        = {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+  [PERF_COUNTER_INSTRUCTIONS]  = {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+  [PERF_COUNTER_L1D_MISSES]    = {PERF_TYPE_HW_CACHE, PERF_CACHE_READ_MISS(PERF_COUNT_HW_CACHE_L1D)},
+  [PERF_COUNTER_LLC_MISSES]    = {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+  [PERF_COUNTER_BRANCH_MISSES] = {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+  [PERF_COUNTER_DTLB_MISSES]   = {PERF_TYPE_HW_CACHE, PERF_CACHE_READ_MISS(PERF_COUNT_HW_CACHE_DTLB)},
+};
+
+// Everything in one group so they're all scheduled on the PMU together, cycles leads if it opens
+typedef struct Perf_Counter_State Perf_Counter_State;
+struct Perf_Counter_State
+{
+  b32 tried;
+  u32 available;
+
+  int                         leader;
+  int                         fds[PERF_COUNTER_COUNT];
+  struct perf_event_mmap_page *pages[PERF_COUNTER_COUNT]; // For rdpmc
+  usize                       group_slots[PERF_COUNTER_COUNT]; // Where each lands in a group read()
+  usize                       group_count;
+};
+
+static thread_static Perf_Counter_State t_perf_counters;
+
+static
+b32 perf_counters_open(void)
+{
+  Perf_Counter_State *state = &t_perf_counters;
+
+  if (!state->tried)
+  {
+    state->tried  = true;
+    state->leader = -1;
+
+    long page_size = sysconf(_SC_PAGESIZE);
+
+    for (usize i = 0; i < PERF_COUNTER_COUNT; i++)
+    {
+      struct perf_event_attr attr =
+      {
+        .type           = perf_counter_specs[i].type,
+        .size           = sizeof(struct perf_event_attr),
+        .config         = perf_counter_specs[i].config,
+        .disabled       = state->leader == -1, // Whole group gets enabled at once through the leader
+        .exclude_kernel = 1,
+        .exclude_hv     = 1,
+        .read_format    = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING,
+      };
+
+      int fd = perf_event_open(&attr, 0, -1, state->leader, 0);
+      if (fd == -1)
+      {
+        state->fds[i] = -1;
+        continue;
+      }
+
+      if (state->leader == -1)
+      {
+        state->leader = fd;
+      }
+
+      state->fds[i]         = fd;
+      state->group_slots[i] = state->group_count++;
+      state->available     |= 1 << i;
+
+      void *page = mmap(NULL, page_size, PROT_READ, MAP_SHARED, fd, 0);
+      state->pages[i] = page == MAP_FAILED ? NULL : (struct perf_event_mmap_page *)page;
+    }
+
+    if (state->leader != -1)
+    {
+      ioctl(state->leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+      ioctl(state->leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+    else
+    {
+      // Every thread will find the same thing, only worth saying once
+      static b32 reported = false;
+      if (!__atomic_exchange_n(&reported, true, __ATOMIC_RELAXED))
+      {
+        LOG_INFO("No hardware performance counters available, perf_event_open: %s", strerror(errno));
+      }
+    }
+  }
+
+  return state->available != 0;
+}
+
+static
+void perf_counters_close(void)
+{
+  Perf_Counter_State *state = &t_perf_counters;
+
+  long page_size = sysconf(_SC_PAGESIZE);
+
+  // Members first, leader last
+  for (isize i = PERF_COUNTER_COUNT - 1; i >= 0; i--)
+  {
+    if (state->available & (1 << i))
+    {
+      if (state->pages[i])
+      {
+        munmap(state->pages[i], page_size);
+      }
+      close(state->fds[i]);
+    }
+  }
 
+  ZERO_STRUCT(state);
+}
+
+static
+u32 perf_counters_available(void)
+{
+  return t_perf_counters.available;
+}
+
+// Seqlock dance from the perf_event_mmap_page docs. False if the kernel won't let us rdpmc right now
+static inline
+b32 perf_read_rdpmc(struct perf_event_mmap_page *page, u64 *value)
+{
+  u32 sequence = 0;
+  u64 result = 0;
+  do
+  {
+    sequence = page->lock;
+    __asm__ volatile("" ::: "memory");
+
+    // Once the group has been multiplexed the raw count needs scaling, the read() path does that
+    u32 index = page->index;
+    if (!page->cap_user_rdpmc || !index || page->time_running != page->time_enabled)
+    {
+      return false;
+    }
+
+    // Counter is only pmc_width bits, sign extend it
+    u64 width = page->pmc_width;
+    i64 count = (i64)(__rdpmc(index - 1) << (64 - width)) >> (64 - width);
+
+    result = page->offset + count;
+
+    __asm__ volatile("" ::: "memory");
+  } while (page->lock != sequence);
+
+  *value = result;
+  return true;
+}
+
+static
+Perf_Counter_Values read_perf_counters(void)
+{
+  Perf_Counter_State *state = &t_perf_counters;
+
+  Perf_Counter_Values result = {0};
+
+  if (state->available)
+  {
+    b32 all_rdpmc = true;
+    for (usize i = 0; i < PERF_COUNTER_COUNT && all_rdpmc; i++)
+    {
+      if (state->available & (1 << i))
+      {
+        all_rdpmc = state->pages[i] && perf_read_rdpmc(state->pages[i], &result.v[i]);
+      }
+    }
+
+    if (!all_rdpmc)
+    {
+      u64 group[3 + PERF_COUNTER_COUNT] = {0}; // nr, time enabled, time running, then values in the order they were opened
+      if (read(state->leader, group, sizeof(group)) > 0)
+      {
+        u64 enabled = group[1];
+        u64 running = group[2];
+
+        // More counters than the PMU has room for get time sliced, so each only counted part of the time.
+        // Never scheduled at all leaves nothing to scale from, so those stay at 0
+        f64 scale = running ? (f64)enabled / (f64)running : 0.0;
+        if (running && running < enabled)
+        {
+          static b32 reported = false;
+          if (!__atomic_exchange_n(&reported, true, __ATOMIC_RELAXED))
+          {
+            LOG_INFO("Hardware counters are being multiplexed, counts are scaled estimates (counted %.1f%% of the time)",
+                     100.0 * (f64)running / (f64)enabled);
+          }
+        }
+
+        for (usize i = 0; i < PERF_COUNTER_COUNT; i++)
+        {
+          u64 value = group[3 + state->group_slots[i]];
+          result.v[i] = (state->available & (1 << i)) ? (running == enabled ? value : (u64)((f64)value * scale)) : 0;
+        }
+      }
+    }
+  }
+
+  return result;
+}
 
 #endif
+
+static
+const char *perf_counter_name(Perf_Counter counter)
+{
+  static const char *names[PERF_COUNTER_COUNT] =
+  {
+    [PERF_COUNTER_CYCLES]        = "cycles",
+    [PERF_COUNTER_INSTRUCTIONS]  = "instructions",
+    [PERF_COUNTER_L1D_MISSES]    = "l1d misses",
+    [PERF_COUNTER_LLC_MISSES]    = "llc misses",
+    [PERF_COUNTER_BRANCH_MISSES] = "branch misses",
+    [PERF_COUNTER_DTLB_MISSES]   = "dtlb misses",
+  };
+
+  return counter < PERF_COUNTER_COUNT ? names[counter] : "unknown";
+}
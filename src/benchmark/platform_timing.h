@@ -24,4 +24,42 @@ u64 estimate_cpu_timer_freq(void);
 static
 f64 cpu_time_in_seconds(u64 cpu_time, u64 cpu_timer_frequency);
 
+// Hardware counters, per thread. Linux only, through perf_event_open(). Any that the machine (or a VM,
+// or perf_event_paranoid) won't give us just read as 0, and if none open at all everything reads 0
+#define Perf_Counter(X)            \
+  X(PERF_COUNTER_CYCLES)           \
+  X(PERF_COUNTER_INSTRUCTIONS)     \
+  X(PERF_COUNTER_L1D_MISSES)       \
+  X(PERF_COUNTER_LLC_MISSES)       \
+  X(PERF_COUNTER_BRANCH_MISSES)    \
+  X(PERF_COUNTER_DTLB_MISSES)      \
+  X(PERF_COUNTER_COUNT)
+
+ENUM_TABLE(Perf_Counter);
+
+typedef struct Perf_Counter_Values Perf_Counter_Values;
+struct Perf_Counter_Values
+{
+  u64 v[PERF_COUNTER_COUNT];
+};
+
+// Opens the counters for the calling thread, only does anything the first time. True if any opened
+static
+b32 perf_counters_open(void);
+
+static
+void perf_counters_close(void);
+
+// Bitmask by Perf_Counter of the ones that opened on this thread
+static
+u32 perf_counters_available(void);
+
+// Uses rdpmc when the kernel lets us, otherwise one read() of the whole group. If the PMU has to time slice
+// the group, counts are scaled up by time enabled over time running, and read 0 if it never got scheduled
+static
+Perf_Counter_Values read_perf_counters(void);
+
+static
+const char *perf_counter_name(Perf_Counter counter);
+
 #endif // PLATFORM_TIMING_H
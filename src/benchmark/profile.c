@@ -3,101 +3,1031 @@
 #include "../common.h"
 #include "platform_timing.h"
 
-static Profiler g_profiler;
+#ifdef OS_LINUX
+#include <signal.h>
+#include <ucontext.h>
+#include <dlfcn.h>
+#endif
+
+// For the whole profiler duration
+static u64 g_profile_start;
+static u64 g_profile_close;
+static u64 g_profile_freq;
+
+// Plain passes from begin_profiling(), redone at the end with events or counters if they got turned on
+static Profile_Overhead g_profile_overhead;
+
+// 0 when not recording events
+static usize g_profile_event_capacity;
+
+static b32 g_profile_use_counters;
+
+// 0 when not sampling
+static u32 g_profile_sample_rate;
+static u64 g_profile_sample_total;   // Filled in by end_profiling()
+static u64 g_profile_samples_unowned; // Timer went off on a thread that never did a pass
+
+// Every thread that ever did a pass, newest first
+static Profiler *g_profilers;
+static usize    g_profiler_count;
+
+static thread_static Profiler *t_profiler;
+
+// Zones are handed out process wide, only while holding the lock. Names are written before the index
+// is published so anyone who can see an index can read its name
+static u32    g_profile_zone_count = 1;
+static String g_profile_zone_names[PROFILE_MAX_ZONES];
+static b8     g_profile_zone_lock;
+
+typedef struct Profile_Name_Slot Profile_Name_Slot;
+struct Profile_Name_Slot
+{
+  u32 hash;
+  u32 zone_index; // 0 is empty, published last
+};
+
+static Profile_Name_Slot g_profile_name_table[PROFILE_NAME_TABLE_COUNT];
+static Arena             g_profile_name_arena; // Copies of runtime names
 
 static
-void begin_profiling()
+void __profile_allocate_samples(Profiler *profiler)
+{
+  profiler->samples = (Profile_Sample *)os_allocate(PROFILE_SAMPLE_CAPACITY * sizeof(Profile_Sample), OS_ALLOCATION_COMMIT);
+}
+
+static
+void __profile_allocate_events(Profiler *profiler, usize event_capacity)
+{
+  profiler->events = (Profile_Event *)os_allocate(event_capacity * sizeof(Profile_Event), OS_ALLOCATION_COMMIT);
+  profiler->event_capacity = profiler->events ? event_capacity : 0;
+  profiler->event_count    = 0;
+}
+
+// Only the very first pass on a thread gets here, so the atomics are paid once per thread
+static
+Profiler *__profile_register_thread()
+{
+  Profiler *profiler = (Profiler *)os_allocate(sizeof(Profiler), OS_ALLOCATION_COMMIT);
+  ASSERT(profiler, "Unable to allocate thread profiler");
+
+  profiler->thread_index = __atomic_fetch_add(&g_profiler_count, 1, __ATOMIC_RELAXED);
+  profiler->thread_name  = profiler->thread_index == 0 ? String("main") : String("worker");
+
+  usize event_capacity = __atomic_load_n(&g_profile_event_capacity, __ATOMIC_RELAXED);
+  if (event_capacity)
+  {
+    __profile_allocate_events(profiler, event_capacity);
+  }
+
+  if (__atomic_load_n(&g_profile_use_counters, __ATOMIC_RELAXED))
+  {
+    profiler->use_counters = perf_counters_open();
+  }
+
+  if (__atomic_load_n(&g_profile_sample_rate, __ATOMIC_RELAXED))
+  {
+    __profile_allocate_samples(profiler);
+  }
+
+  profiler->next = __atomic_load_n(&g_profilers, __ATOMIC_RELAXED);
+  while (!__atomic_compare_exchange_n(&g_profilers, &profiler->next, profiler, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+  {
+    // profiler->next got refreshed, try again
+  }
+
+  t_profiler = profiler;
+
+  return profiler;
+}
+
+static inline
+Profiler *__profile_thread_profiler()
+{
+  Profiler *profiler = t_profiler;
+  if (!profiler)
+  {
+    profiler = __profile_register_thread();
+  }
+
+  return profiler;
+}
+
+PROFILE_FUNCTION
+void __profile_set_thread_name(String name)
+{
+  __profile_thread_profiler()->thread_name = name;
+}
+
+PROFILE_FUNCTION
+void profile_record_events(usize event_capacity)
+{
+  // Power of 2 so the ring index is just a mask
+  usize capacity = 1;
+  while (capacity < event_capacity)
+  {
+    capacity <<= 1;
+  }
+
+  __atomic_store_n(&g_profile_event_capacity, capacity, __ATOMIC_RELAXED);
+
+  Profiler *profiler = __profile_thread_profiler();
+  if (!profiler->events)
+  {
+    __profile_allocate_events(profiler, capacity);
+  }
+}
+
+PROFILE_FUNCTION
+b32 profile_enable_counters(void)
+{
+  Profiler *profiler = __profile_thread_profiler();
+
+  // A pass that is already open pushed no counter frame, so closing it would pop one that isn't there
+  if (profiler->current_parent_zone != 0)
+  {
+    LOG_ERROR("Hardware counters can only be enabled outside of any profile pass");
+    return false;
+  }
+
+  __atomic_store_n(&g_profile_use_counters, true, __ATOMIC_RELAXED);
+
+  profiler->use_counters = perf_counters_open();
+
+  return profiler->use_counters;
+}
+
+#ifdef OS_LINUX
+// Runs on whichever thread was burning cpu. Only touches that thread's own profiler, and nothing
+// outside of the handler ever writes sample_count or the sample ring, so no atomics needed
+static
+void __profile_sample_signal(int signal_number, siginfo_t *info, void *context)
 {
-  g_profiler = (Profiler)
+  Profiler *profiler = t_profiler;
+  if (!profiler)
   {
-    .start = read_cpu_timer(),
+    __atomic_fetch_add(&g_profile_samples_unowned, 1, __ATOMIC_RELAXED);
+    return;
+  }
+
+  usize zone_index = profiler->current_parent_zone;
+  profiler->zones[zone_index].sample_count += 1;
+
+  if (profiler->samples)
+  {
+    ucontext_t *ucontext = (ucontext_t *)context;
+
+    Profile_Sample *sample = profiler->samples + (profiler->sample_count & (PROFILE_SAMPLE_CAPACITY - 1));
+    sample->ip         = (u64)ucontext->uc_mcontext.gregs[REG_RIP];
+    sample->zone_index = zone_index;
+
+    profiler->sample_count += 1;
+  }
+}
+
+PROFILE_FUNCTION
+b32 profile_enable_sampling(u32 samples_per_second)
+{
+  samples_per_second = CLAMP(samples_per_second, 1, 1000000);
+
+  __atomic_store_n(&g_profile_sample_rate, samples_per_second, __ATOMIC_RELAXED);
+
+  Profiler *profiler = __profile_thread_profiler();
+  if (!profiler->samples)
+  {
+    __profile_allocate_samples(profiler);
+  }
+
+  struct sigaction action = {0};
+  action.sa_sigaction = __profile_sample_signal;
+  action.sa_flags     = SA_SIGINFO|SA_RESTART;
+  sigemptyset(&action.sa_mask);
+
+  if (sigaction(SIGPROF, &action, NULL) != 0)
+  {
+    LOG_ERROR("Unable to install SIGPROF handler for sampling");
+    g_profile_sample_rate = 0;
+    return false;
+  }
+
+  u64 interval_us = 1000000 / samples_per_second;
+  struct itimerval timer =
+  {
+    .it_interval = {.tv_sec = interval_us / 1000000, .tv_usec = interval_us % 1000000},
+    .it_value    = {.tv_sec = interval_us / 1000000, .tv_usec = interval_us % 1000000},
   };
+
+  if (setitimer(ITIMER_PROF, &timer, NULL) != 0)
+  {
+    LOG_ERROR("Unable to start ITIMER_PROF for sampling");
+    g_profile_sample_rate = 0;
+    return false;
+  }
+
+  return true;
+}
+
+static
+void __profile_stop_sampling()
+{
+  struct itimerval timer = {0};
+  setitimer(ITIMER_PROF, &timer, NULL);
+}
+
+// Where an address lives, for addr2line. Only exported symbols get names
+static
+void __profile_print_address(u64 ip)
+{
+  Dl_info info = {0};
+  if (dladdr((void *)ip, &info) && info.dli_fname)
+  {
+    printf("%s+0x%lx", info.dli_fname, ip - (u64)info.dli_fbase);
+    if (info.dli_sname)
+    {
+      printf(" (%s)", info.dli_sname);
+    }
+  }
+  else
+  {
+    printf("0x%lx", ip);
+  }
+}
+#else
+PROFILE_FUNCTION
+b32 profile_enable_sampling(u32 samples_per_second)
+{
+  LOG_ERROR("Sampling profiler only supported on linux");
+  return false;
+}
+
+static
+void __profile_stop_sampling()
+{
+}
+
+static
+void __profile_print_address(u64 ip)
+{
+  printf("0x%lx", ip);
+}
+#endif // OS_LINUX
+
+static
+int __profile_compare_samples(const void *a, const void *b)
+{
+  u64 a_ip = ((const Profile_Sample *)a)->ip;
+  u64 b_ip = ((const Profile_Sample *)b)->ip;
+
+  return (a_ip > b_ip) - (a_ip < b_ip);
+}
+
+// Every sample still in the rings, grouped by address, the most hit ones
+static
+void __profile_print_top_samples()
+{
+  usize kept = 0;
+  for (Profiler *profiler = g_profilers; profiler; profiler = profiler->next)
+  {
+    kept += MIN(profiler->sample_count, PROFILE_SAMPLE_CAPACITY);
+  }
+
+  if (!kept)
+  {
+    return;
+  }
+
+  Profile_Sample *all = (Profile_Sample *)os_allocate(kept * sizeof(Profile_Sample), OS_ALLOCATION_COMMIT);
+  if (!all)
+  {
+    return;
+  }
+
+  usize at = 0;
+  for (Profiler *profiler = g_profilers; profiler; profiler = profiler->next)
+  {
+    usize count = MIN(profiler->sample_count, PROFILE_SAMPLE_CAPACITY);
+    MEM_COPY(all + at, profiler->samples, count * sizeof(Profile_Sample));
+    at += count;
+  }
+
+  qsort(all, kept, sizeof(Profile_Sample), __profile_compare_samples);
+
+  // Runs of the same address, keep the biggest few, sorted biggest first
+  Profile_Sample top[PROFILE_TOP_SAMPLE_IPS] = {0};
+  usize          top_hits[PROFILE_TOP_SAMPLE_IPS] = {0};
+
+  for (usize run_start = 0; run_start < kept;)
+  {
+    usize run_close = run_start + 1;
+    while (run_close < kept && all[run_close].ip == all[run_start].ip)
+    {
+      run_close += 1;
+    }
+
+    usize hits = run_close - run_start;
+    for (usize i = 0; i < PROFILE_TOP_SAMPLE_IPS; i++)
+    {
+      if (hits > top_hits[i])
+      {
+        for (usize j = PROFILE_TOP_SAMPLE_IPS - 1; j > i; j--)
+        {
+          top[j]      = top[j - 1];
+          top_hits[j] = top_hits[j - 1];
+        }
+        top[i]      = all[run_start];
+        top_hits[i] = hits;
+        break;
+      }
+    }
+
+    run_start = run_close;
+  }
+
+  printf("  Hottest Addresses (of %lu kept samples):\n", kept);
+  for (usize i = 0; i < PROFILE_TOP_SAMPLE_IPS && top_hits[i]; i++)
+  {
+    String zone_name = top[i].zone_index ? g_profile_zone_names[top[i].zone_index] : String("[no zone]");
+
+    printf("    %lu (%.2f%%) in '%.*s' at ", top_hits[i], 100.0 * (f64)top_hits[i] / (f64)kept, String_Format(zone_name));
+    __profile_print_address(top[i].ip);
+    printf("\n");
+  }
+
+  os_deallocate(all, kept * sizeof(Profile_Sample));
+}
+
+static inline
+Profile_Event *__profile_push_event(Profiler *profiler, usize zone_index, Profile_Event_Type type)
+{
+  Profile_Event *event = profiler->events + (profiler->event_count & (profiler->event_capacity - 1));
+  event->zone_index = zone_index;
+  event->type       = type;
+
+  profiler->event_count += 1;
+
+  return event;
+}
+
+// Empty passes on a scratch profiler swapped in for this thread so none of it shows up in the real
+// zones. Best of a bunch of runs, what's left is the cost of the pass itself
+static
+Profile_Overhead __profile_calibrate(b32 record_events, b32 use_counters)
+{
+  Profile_Overhead result = {0};
+
+  Profiler *real = t_profiler;
+
+  Profiler *scratch = (Profiler *)os_allocate(sizeof(Profiler), OS_ALLOCATION_COMMIT);
+  if (!scratch)
+  {
+    return result;
+  }
+
+  usize pass_count = 1024;
+
+  scratch->use_counters = use_counters;
+  if (record_events)
+  {
+    __profile_allocate_events(scratch, 2 * pass_count);
+  }
+
+  t_profiler = scratch;
+
+  u64 best_pass   = UINT64_MAX;
+  u64 best_inside = UINT64_MAX;
+  for (usize rep = 0; rep < 64; rep++)
+  {
+    ZERO_STRUCT(&scratch->zones[1]);
+
+    u64 start = read_cpu_timer();
+    for (usize i = 0; i < pass_count; i++)
+    {
+      __profile_close_pass(__profile_begin_pass(1, 0));
+    }
+    best_pass   = MIN(best_pass, read_cpu_timer() - start);
+    best_inside = MIN(best_inside, scratch->zones[1].elapsed_inclusive);
+  }
+
+  t_profiler = real;
+
+  result.pass_cycles   = (f64)best_pass / (f64)pass_count;
+  result.inside_cycles = MIN((f64)best_inside / (f64)pass_count, result.pass_cycles);
+
+  if (scratch->events)
+  {
+    os_deallocate(scratch->events, scratch->event_capacity * sizeof(Profile_Event));
+  }
+  os_deallocate(scratch, sizeof(Profiler));
+
+  return result;
+}
+
+PROFILE_FUNCTION
+void begin_profiling()
+{
+  // Makes sure the calling thread is thread 0
+  __profile_thread_profiler();
+
+  g_profile_overhead = __profile_calibrate(false, false);
+
+  g_profile_start = read_cpu_timer();
+}
+
+static
+void __profile_print_zone(String name, Profile_Zone *zone, u64 total_delta, u64 freq, const char *prefix, const char *indent)
+{
+  f64 percent = ((f64)zone->elapsed_exclusive / (f64)total_delta) * 100.0;
+
+  printf("%sZone '%.*s':\n"
+         "%s  Hit Count: %lu\n"
+         "%s  Exclusive Timestamp Cycles: %lu (%.4f%%)\n"
+         , prefix, String_Format(name), indent, zone->hit_count, indent, zone->elapsed_exclusive, percent);
+
+  if (zone->elapsed_exclusive != zone->elapsed_inclusive)
+  {
+    f64 with_children_percent = ((f64)zone->elapsed_inclusive / (f64)total_delta) * 100.0;
+    printf("%s  Inclusive Timestamp Cycles: %lu (%.4f%%)\n", indent, zone->elapsed_inclusive, with_children_percent);
+  }
+
+  if (zone->bytes_processed)
+  {
+    f64 megabytes = (f64)zone->bytes_processed / MB(1);
+
+    f64 gb_per_s = (f64)zone->bytes_processed / ((f64)zone->elapsed_inclusive / (f64)freq) / (f64)GB(1.0);
+
+    printf("%s  Megabytes Processed: %fMB @ %f GB/s\n", indent, megabytes, gb_per_s);
+  }
+
+  // Each pass leaves its inside part in its own zone and the rest in the zone around it
+  if (g_profile_overhead.pass_cycles > 0.0)
+  {
+    f64 inside  = g_profile_overhead.inside_cycles;
+    f64 outside = g_profile_overhead.pass_cycles - inside;
+
+    f64 exclusive_overhead = (f64)zone->hit_count * inside + (f64)zone->child_hit_count * outside;
+    f64 inclusive_overhead = (f64)zone->outer_hit_count * inside + (f64)zone->nested_hit_count * g_profile_overhead.pass_cycles;
+
+    u64 exclusive = (u64)MAX((f64)zone->elapsed_exclusive - exclusive_overhead, 0.0);
+    u64 inclusive = (u64)MAX((f64)zone->elapsed_inclusive - inclusive_overhead, 0.0);
+
+    f64 overhead_percent = zone->elapsed_inclusive ? 100.0 * inclusive_overhead / (f64)zone->elapsed_inclusive : 0.0;
+    overhead_percent = MIN(overhead_percent, 100.0);
+
+    printf("%s  Estimated Instrumentation Overhead: %.0f cycles (%.2f%% of the zone)\n", indent, inclusive_overhead, overhead_percent);
+    printf("%s  Overhead Corrected Cycles: %lu exclusive (%.4f%%)", indent, exclusive, 100.0 * (f64)exclusive / (f64)total_delta);
+    if (zone->elapsed_exclusive != zone->elapsed_inclusive)
+    {
+      printf(", %lu inclusive (%.4f%%)", inclusive, 100.0 * (f64)inclusive / (f64)total_delta);
+    }
+    printf("\n");
+
+    if (overhead_percent > PROFILE_OVERHEAD_WARN_PERCENT)
+    {
+      printf("%s  WARNING: Over %.0f%% of this zone is the profiler itself, its numbers are skewed\n", indent, PROFILE_OVERHEAD_WARN_PERCENT);
+    }
+  }
+
+  if (g_profile_sample_total)
+  {
+    f64 sample_percent = 100.0 * (f64)zone->sample_count / (f64)g_profile_sample_total;
+    printf("%s  Samples: %lu (%.4f%% sampled vs %.4f%% instrumented)\n", indent, zone->sample_count, sample_percent, percent);
+  }
+
+  // Spread only means something with a few hits
+  if (zone->hit_count > 1)
+  {
+    printf("%s  Inclusive Cycles Per Hit: ", indent);
+    print_latency_histogram_percentiles("", &zone->hit_cycles);
+    printf("\n");
+  }
+
+  b32 any_counters = false;
+  for (usize i = 0; i < PERF_COUNTER_COUNT; i++)
+  {
+    any_counters |= zone->counters[i] != 0;
+  }
+
+  if (any_counters)
+  {
+    printf("%s  Counters:", indent);
+    for (usize i = 0; i < PERF_COUNTER_COUNT; i++)
+    {
+      if (zone->counters[i])
+      {
+        printf(" %lu %s,", zone->counters[i], perf_counter_name(i));
+      }
+    }
+
+    if (zone->counters[PERF_COUNTER_CYCLES] && zone->counters[PERF_COUNTER_INSTRUCTIONS])
+    {
+      printf(" %.2f ipc", (f64)zone->counters[PERF_COUNTER_INSTRUCTIONS] / (f64)zone->counters[PERF_COUNTER_CYCLES]);
+    }
+    printf("\n");
+  }
 }
 
+// Sums up one zone across every thread that hit it, gives back how many did
 static
+usize __profile_merge_zone(usize zone_index, Profile_Zone *merged)
+{
+  usize zone_threads = 0;
+
+  for (Profiler *profiler = g_profilers; profiler; profiler = profiler->next)
+  {
+    Profile_Zone *zone = &profiler->zones[zone_index];
+    if (zone->elapsed_inclusive)
+    {
+      merged->elapsed_exclusive += zone->elapsed_exclusive;
+      merged->elapsed_inclusive += zone->elapsed_inclusive;
+      merged->hit_count         += zone->hit_count;
+      merged->bytes_processed   += zone->bytes_processed;
+      merged->sample_count      += zone->sample_count;
+      merged->child_hit_count   += zone->child_hit_count;
+      merged->outer_hit_count   += zone->outer_hit_count;
+      merged->nested_hit_count  += zone->nested_hit_count;
+      for (usize counter = 0; counter < PERF_COUNTER_COUNT; counter++)
+      {
+        merged->counters[counter] += zone->counters[counter];
+      }
+      latency_histogram_merge(&merged->hit_cycles, &zone->hit_cycles);
+
+      zone_threads += 1;
+    }
+  }
+
+  return zone_threads;
+}
+
+PROFILE_FUNCTION
 void end_profiling()
 {
-  u64 total_delta = read_cpu_timer() - g_profiler.start;
+  g_profile_close = read_cpu_timer();
+
+  if (g_profile_sample_rate)
+  {
+    __profile_stop_sampling();
+  }
+
+  u64 total_delta = g_profile_close - g_profile_start;
+
+  usize thread_count = __atomic_load_n(&g_profiler_count, __ATOMIC_ACQUIRE);
+
+  // Percentages of samples are out of everything, including time outside any zone
+  u64 samples_outside = __atomic_load_n(&g_profile_samples_unowned, __ATOMIC_RELAXED);
+  g_profile_sample_total = samples_outside;
+  for (Profiler *profiler = g_profilers; profiler; profiler = profiler->next)
+  {
+    for (usize i = 0; i < STATIC_ARRAY_COUNT(profiler->zones); i++)
+    {
+      g_profile_sample_total += profiler->zones[i].sample_count;
+    }
+    samples_outside += profiler->zones[0].sample_count;
+  }
 
   if (total_delta)
   {
     u64 freq = estimate_cpu_timer_freq();
+    g_profile_freq = freq;
+
     printf("[PROFILE] Total duration: %lu (%f ms @ %lu Hz)\n", total_delta, (f64)total_delta / (f64)freq * 1000.0, freq);
 
-    f64 exclusive_percent = 0.0;
+    // Events and counters make every pass dearer, and they get turned on after begin_profiling()
+    if (t_profiler->events || t_profiler->use_counters)
+    {
+      g_profile_overhead = __profile_calibrate(t_profiler->events != NULL, t_profiler->use_counters);
+    }
+
+    printf("[PROFILE] Pass Overhead: %.2f cycles, %.2f of them inside the zone's own time\n",
+           g_profile_overhead.pass_cycles, g_profile_overhead.inside_cycles);
 
-    for (usize i = 0; i < STATIC_ARRAY_COUNT(g_profiler.zones); i++)
+    // Everything summed across threads. Cycles add up across cores, so with more than one thread a
+    // zone can be over 100% of the wall clock duration, and bandwidth is per thread
+    for (usize i = 0; i < STATIC_ARRAY_COUNT(t_profiler->zones); i++)
     {
-      Profile_Zone *zone = &g_profiler.zones[i];
+      Profile_Zone merged = {0};
+      usize zone_threads = __profile_merge_zone(i, &merged);
 
-      if (zone->elapsed_inclusive)
+      if (merged.elapsed_inclusive)
       {
-        f64 percent = ((f64)zone->elapsed_exclusive / (f64)total_delta) * 100.0;
-
-        printf("[PROFILE] Zone '%.*s':\n"
-               "  Hit Count: %lu\n"
-               "  Exclusive Timestamp Cycles: %lu (%.4f%%)\n"
-               , String_Format(zone->name), zone->hit_count, zone->elapsed_exclusive, percent);
+        __profile_print_zone(g_profile_zone_names[i], &merged, total_delta, freq, "[PROFILE] ", "");
 
-        if (zone->elapsed_exclusive != zone->elapsed_inclusive)
+        if (zone_threads > 1)
         {
-          f64 with_children_percent = ((f64)zone->elapsed_inclusive / (f64)total_delta) * 100.0;
-          printf("  Inclusive Timestamp Cycles: %lu (%.4f%%)\n", zone->elapsed_inclusive, with_children_percent);
+          printf("  Threads: %lu\n", zone_threads);
         }
+      }
+    }
 
-        exclusive_percent += percent;
-
-        if (zone->bytes_processed)
+    // Then each thread on its own, only interesting when there's more than one
+    if (thread_count > 1)
+    {
+      for (usize thread_index = 0; thread_index < thread_count; thread_index++)
+      {
+        for (Profiler *profiler = g_profilers; profiler; profiler = profiler->next)
         {
-          f64 megabytes = (f64)zone->bytes_processed / MB(1);
+          if (profiler->thread_index != thread_index)
+          {
+            continue;
+          }
 
-          f64 gb_per_s = (f64)zone->bytes_processed / ((f64)zone->elapsed_inclusive / (f64)freq) / (f64)GB(1.0);
+          printf("[PROFILE] Thread %lu '%.*s':\n", thread_index, String_Format(profiler->thread_name));
 
-          printf("  Megabytes Processed: %fMB @ %f GB/s\n", megabytes, gb_per_s);
+          for (usize i = 0; i < STATIC_ARRAY_COUNT(profiler->zones); i++)
+          {
+            if (profiler->zones[i].elapsed_inclusive)
+            {
+              __profile_print_zone(g_profile_zone_names[i], &profiler->zones[i], total_delta, freq, "  ", "  ");
+            }
+          }
         }
       }
     }
   }
+
+  if (g_profile_sample_rate)
+  {
+    f64 outside_percent = g_profile_sample_total ? 100.0 * (f64)samples_outside / (f64)g_profile_sample_total : 0.0;
+    printf("[PROFILE] Samples: %lu @ %u Hz of cpu time, %lu (%.2f%%) outside any zone\n",
+           g_profile_sample_total, g_profile_sample_rate, samples_outside, outside_percent);
+
+    __profile_print_top_samples();
+  }
+
+  if (g_profile_event_capacity)
+  {
+    usize recorded = 0;
+    usize dropped  = 0;
+    for (Profiler *profiler = g_profilers; profiler; profiler = profiler->next)
+    {
+      recorded += profiler->event_count;
+      dropped  += profiler->event_count - MIN(profiler->event_count, profiler->event_capacity);
+    }
+
+    f64 plain_cycles  = __profile_calibrate(false, false).pass_cycles;
+    f64 record_cycles = __profile_calibrate(true, false).pass_cycles;
+
+    printf("[PROFILE] Events: %lu recorded, %lu dropped (ring of %lu per thread)\n"
+           "  Pass Cycles: %.2f recording, %.2f without (%.2f per pass to record)\n",
+           recorded, dropped, g_profile_event_capacity, record_cycles, plain_cycles, record_cycles - plain_cycles);
+  }
 }
 
 static
-Profile_Pass __profile_begin_pass(String name, usize zone_index, u64 bytes_processed)
+void __profile_lock_zones()
 {
+  while (__atomic_test_and_set(&g_profile_zone_lock, __ATOMIC_ACQUIRE))
+  {
+    // Only ever held to hand out a zone, so not for long
+  }
+}
+
+static
+void __profile_unlock_zones()
+{
+  __atomic_clear(&g_profile_zone_lock, __ATOMIC_RELEASE);
+}
+
+// Holding the lock
+static
+u32 __profile_new_zone(String name)
+{
+  u32 zone_index = PROFILE_MAX_ZONES - 1;
+
+  if (g_profile_zone_count < PROFILE_MAX_ZONES - 1)
+  {
+    zone_index = g_profile_zone_count;
+    g_profile_zone_count += 1;
+
+    g_profile_zone_names[zone_index] = name;
+  }
+  else if (!g_profile_zone_names[zone_index].count)
+  {
+    LOG_ERROR("Ran out of profile zones (%d), the rest get lumped together", PROFILE_MAX_ZONES);
+    g_profile_zone_names[zone_index] = String("[out of zones]");
+  }
+
+  return zone_index;
+}
+
+PROFILE_FUNCTION
+u32 __profile_register_static_zone(u32 *slot, String name)
+{
+  __profile_lock_zones();
+
+  // Another thread may have gotten here first for the same site
+  u32 zone_index = __atomic_load_n(slot, __ATOMIC_RELAXED);
+  if (!zone_index)
+  {
+    zone_index = __profile_new_zone(name);
+    __atomic_store_n(slot, zone_index, __ATOMIC_RELEASE);
+  }
+
+  __profile_unlock_zones();
+
+  return zone_index;
+}
+
+// Readers don't lock, they stop at the first empty slot, and slots only ever go from empty to full
+static
+Profile_Name_Slot *__profile_find_name(String name, u32 hash)
+{
+  Profile_Name_Slot *result = NULL;
+
+  usize mask = PROFILE_NAME_TABLE_COUNT - 1;
+  for (usize i = hash & mask;; i = (i + 1) & mask)
+  {
+    Profile_Name_Slot *slot = g_profile_name_table + i;
+
+    u32 zone_index = __atomic_load_n(&slot->zone_index, __ATOMIC_ACQUIRE);
+    if (!zone_index || (slot->hash == hash && string_match(g_profile_zone_names[zone_index], name)))
+    {
+      result = slot;
+      break;
+    }
+  }
+
+  return result;
+}
+
+PROFILE_FUNCTION
+u32 profile_zone_named(String name)
+{
+  u32 hash = string_hash_u32(name);
+
+  Profile_Name_Slot *slot = __profile_find_name(name, hash);
+  u32 zone_index = __atomic_load_n(&slot->zone_index, __ATOMIC_ACQUIRE);
+
+  if (!zone_index)
+  {
+    __profile_lock_zones();
+
+    // Somebody might have added it, or something else, since looking
+    slot = __profile_find_name(name, hash);
+    zone_index = __atomic_load_n(&slot->zone_index, __ATOMIC_RELAXED);
+
+    if (!zone_index)
+    {
+      if (!g_profile_name_arena.base)
+      {
+        g_profile_name_arena = arena_make(.reserve_size = MB(1), .commit_size = KB(4));
+      }
+
+      String copy = {.v = arena_calloc(&g_profile_name_arena, name.count, u8), .count = name.count};
+      MEM_COPY(copy.v, name.v, name.count);
+
+      zone_index = __profile_new_zone(copy);
+
+      // Table has twice the zones, so it never fills. Out of zones names all share the last zone
+      slot->hash = hash;
+      __atomic_store_n(&slot->zone_index, zone_index, __ATOMIC_RELEASE);
+    }
+
+    __profile_unlock_zones();
+  }
+
+  return zone_index;
+}
+
+PROFILE_FUNCTION
+Profile_Pass __profile_begin_pass(usize zone_index, u64 bytes_processed)
+{
+  Profiler *profiler = __profile_thread_profiler();
+
   Profile_Pass pass =
   {
-    .parent_index = g_profiler.current_parent_zone,
-    .name         = name,
+    .parent_index = profiler->current_parent_zone,
     .zone_index   = zone_index,
-    .old_elapsed_inclusive = g_profiler.zones[zone_index].elapsed_inclusive, // Save the original so it get overwritten in the case of children
+    .old_elapsed_inclusive = profiler->zones[zone_index].elapsed_inclusive, // Save the original so it get overwritten in the case of children
     .bytes_processed = bytes_processed,
+    .passes_before        = profiler->pass_count,
+    .old_outer_hit_count  = profiler->zones[zone_index].outer_hit_count,
+    .old_nested_hit_count = profiler->zones[zone_index].nested_hit_count,
   };
 
   // Push parent
-  g_profiler.current_parent_zone = zone_index;
+  profiler->current_parent_zone = zone_index;
 
-  // Last!
+  if (profiler->use_counters)
+  {
+    if (profiler->counter_depth < PROFILE_COUNTER_STACK_DEPTH)
+    {
+      Profile_Counter_Frame *frame = profiler->counter_stack + profiler->counter_depth;
+      MEM_COPY(frame->old_inclusive.v, profiler->zones[zone_index].counters, sizeof(frame->old_inclusive.v));
+      frame->start = read_perf_counters();
+    }
+    profiler->counter_depth += 1;
+  }
+
+  Profile_Event *event = NULL;
+  if (profiler->events)
+  {
+    event = __profile_push_event(profiler, zone_index, PROFILE_EVENT_BEGIN);
+  }
+
+  // Last! (bar filling in the event's timestamp)
   pass.start = read_cpu_timer();
 
+  if (event)
+  {
+    event->timestamp = pass.start;
+  }
+
   return pass;
 }
 
-static
+PROFILE_FUNCTION
 void __profile_close_pass(Profile_Pass pass)
 {
   // First!
   u64 elapsed = read_cpu_timer() - pass.start;
 
+  // Same thread that began it, so already registered
+  Profiler *profiler = t_profiler;
+
   // Pop parent
-  g_profiler.current_parent_zone = pass.parent_index;
+  profiler->current_parent_zone = pass.parent_index;
 
-  Profile_Zone *current = &g_profiler.zones[pass.zone_index];
+  Profile_Zone *current = &profiler->zones[pass.zone_index];
   current->elapsed_exclusive += elapsed;
   current->hit_count += 1;
-  current->name = pass.name; // Stupid...
   current->elapsed_inclusive = pass.old_elapsed_inclusive + elapsed; // So that only the final out of potential recursive calls writes inclusive time
   current->bytes_processed += pass.bytes_processed;
+  latency_histogram_add(&current->hit_cycles, elapsed);
+
+  // Like inclusive time, only the outermost of any recursion sticks
+  current->outer_hit_count  = pass.old_outer_hit_count + 1;
+  current->nested_hit_count = pass.old_nested_hit_count + (profiler->pass_count - pass.passes_before);
+  profiler->pass_count += 1;
 
   // Accumulate to parent time
-  Profile_Zone *parent = &g_profiler.zones[pass.parent_index];
+  Profile_Zone *parent = &profiler->zones[pass.parent_index];
   parent->elapsed_exclusive -= elapsed;
+  parent->child_hit_count   += 1;
+
+  if (profiler->use_counters)
+  {
+    profiler->counter_depth -= 1;
+    if (profiler->counter_depth < PROFILE_COUNTER_STACK_DEPTH)
+    {
+      Perf_Counter_Values close = read_perf_counters();
+
+      // Same as inclusive time, only the outermost of any recursion sticks
+      Profile_Counter_Frame *frame = profiler->counter_stack + profiler->counter_depth;
+      for (usize i = 0; i < PERF_COUNTER_COUNT; i++)
+      {
+        current->counters[i] = frame->old_inclusive.v[i] + (close.v[i] - frame->start.v[i]);
+      }
+    }
+  }
+
+  if (profiler->events)
+  {
+    Profile_Event *event = __profile_push_event(profiler, pass.zone_index, PROFILE_EVENT_CLOSE);
+    event->timestamp = pass.start + elapsed;
+  }
+}
+
+PROFILE_FUNCTION
+b32 profile_write_results(String path)
+{
+  FILE *file = benchmark_results_open(path);
+  if (!file)
+  {
+    return false;
+  }
+
+  u64 freq = g_profile_freq ? g_profile_freq : estimate_cpu_timer_freq();
+
+  for (usize i = 0; i < PROFILE_MAX_ZONES; i++)
+  {
+    Profile_Zone merged = {0};
+    __profile_merge_zone(i, &merged);
+
+    if (merged.elapsed_inclusive)
+    {
+      Benchmark_Record record =
+      {
+        .kind       = String("zone"),
+        .name       = g_profile_zone_names[i],
+        .count      = merged.hit_count,
+        .min_cycles = merged.elapsed_inclusive,
+        .avg_cycles = merged.elapsed_inclusive,
+        .max_cycles = merged.elapsed_inclusive,
+        .bytes      = merged.bytes_processed,
+        .cpu_timer_frequency = freq,
+      };
+      MEM_COPY(record.counters, merged.counters, sizeof(record.counters));
+
+      benchmark_results_write(file, &record);
+    }
+  }
+
+  fclose(file);
+
+  return true;
+}
+
+// Names come from the user (thread names, runtime zone names), so quotes and backslashes get escaped
+// and control characters written as \u escapes to keep the trace valid json
+static
+void __profile_write_json_string(FILE *file, String string)
+{
+  for (usize i = 0; i < string.count; i++)
+  {
+    u8 c = string.v[i];
+    if (c == '"' || c == '\\')
+    {
+      fputc('\\', file);
+      fputc(c, file);
+    }
+    else if (c < 0x20)
+    {
+      fprintf(file, "\\u%04x", c);
+    }
+    else
+    {
+      fputc(c, file);
+    }
+  }
+}
+
+// Rings may have wrapped, so a close can show up whose begin got dropped (skipped), and anything still
+// open at the end gets closed at end_profiling()
+PROFILE_FUNCTION
+b32 profile_write_chrome_trace(String path)
+{
+  char name[4096] = {0};
+  MEM_COPY(name, path.v, MIN(path.count, sizeof(name) - 1));
+
+  FILE *file = fopen(name, "wb");
+  if (!file)
+  {
+    LOG_ERROR("Unable to open '%.*s' for writing chrome trace", String_Format(path));
+    return false;
+  }
+
+  u64 freq = g_profile_freq ? g_profile_freq : estimate_cpu_timer_freq();
+  f64 micros_per_cycle = 1000000.0 / (f64)freq;
+
+  usize thread_count = __atomic_load_n(&g_profiler_count, __ATOMIC_ACQUIRE);
+
+  fprintf(file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+  fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":0,\"tid\":0,\"args\":{\"name\":\"profile\"}}");
+
+  for (usize thread_index = 0; thread_index < thread_count; thread_index++)
+  {
+    for (Profiler *profiler = g_profilers; profiler; profiler = profiler->next)
+    {
+      if (profiler->thread_index != thread_index)
+      {
+        continue;
+      }
+
+      fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%lu,\"args\":{\"name\":\"", thread_index);
+      __profile_write_json_string(file, profiler->thread_name);
+      fprintf(file, "\"}}");
+
+      usize first = profiler->event_count - MIN(profiler->event_count, profiler->event_capacity);
+      usize depth = 0;
+      for (usize i = first; i < profiler->event_count; i++)
+      {
+        Profile_Event *event = profiler->events + (i & (profiler->event_capacity - 1));
+
+        if (event->type == PROFILE_EVENT_CLOSE)
+        {
+          if (!depth)
+          {
+            continue;
+          }
+          depth -= 1;
+        }
+        else
+        {
+          depth += 1;
+        }
+
+        String zone_name = g_profile_zone_names[event->zone_index];
+        if (!zone_name.count)
+        {
+          zone_name = String("[unnamed]");
+        }
+
+        f64 micros = (f64)(event->timestamp - g_profile_start) * micros_per_cycle;
+        fprintf(file, ",\n{\"name\":\"");
+        __profile_write_json_string(file, zone_name);
+        fprintf(file, "\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":0,\"tid\":%lu}",
+                event->type == PROFILE_EVENT_BEGIN ? 'B' : 'E', micros, thread_index);
+      }
+
+      f64 close_micros = (f64)(g_profile_close - g_profile_start) * micros_per_cycle;
+      for (; depth; depth--)
+      {
+        fprintf(file, ",\n{\"ph\":\"E\",\"ts\":%.3f,\"pid\":0,\"tid\":%lu}", close_micros, thread_index);
+      }
+    }
+  }
+
+  fprintf(file, "\n]}\n");
+  fclose(file);
+
+  return true;
 }
@@ -1,61 +1,213 @@
 #ifndef PROFILE_H
 #define PROFILE_H
 #include "../common.h"
+#include "platform_timing.h"
+#include "latency_histogram.h"
+#include "benchmark_results.h"
+
+// Unity builds get everything static. With more than one translation unit, define PROFILE_SHARED for all
+// of them and include profile.c in exactly one, the rest just include this header
+#ifdef PROFILE_SHARED
+  #define PROFILE_FUNCTION
+#else
+  #define PROFILE_FUNCTION static
+#endif
+
+// Zone 0 is the root every top level pass parents to, and the last one catches anything past the limit
+#define PROFILE_MAX_ZONES 4096
+
+// Interned runtime zone names, twice the zones so probing stays short
+#define PROFILE_NAME_TABLE_COUNT (2 * PROFILE_MAX_ZONES)
 
 // Just for storing actual timing info and where we need to save that to
 typedef struct Profile_Pass Profile_Pass;
 struct Profile_Pass
 {
-  String name;
   u64    start;
   u64    old_elapsed_inclusive;
   usize  zone_index;
   usize  parent_index;
   u64    bytes_processed;
+
+  // For overhead correction, same save and overwrite as old_elapsed_inclusive
+  u64    passes_before; // Passes closed on this thread before this one began
+  u64    old_outer_hit_count;
+  u64    old_nested_hit_count;
 };
 
 // Here we collect info on 'zones' which is all the times a 'pass' hits it
 typedef struct Profile_Zone Profile_Zone;
 struct Profile_Zone
 {
-  String name;
   u64    elapsed_exclusive; // Not including child zones
   u64    elapsed_inclusive; // Incuding child zones
   u64    hit_count;
   u64    bytes_processed;
+
+  // How many passes left profiler overhead in this zone's times, see Profile_Overhead
+  u64    child_hit_count;  // Passes directly inside, in exclusive
+  u64    outer_hit_count;  // Hits not inside another hit of the same zone, in inclusive
+  u64    nested_hit_count; // Passes anywhere inside those, in inclusive
+
+  u64    counters[PERF_COUNTER_COUNT]; // Including child zones, only with profile_enable_counters()
+
+  Latency_Histogram hit_cycles; // Inclusive, one per hit
+
+  u64    sample_count; // Only when sampling, times this was the innermost zone when the timer went off
+};
+
+// Only when recording events, see profile_record_events()
+typedef enum Profile_Event_Type
+{
+  PROFILE_EVENT_BEGIN,
+  PROFILE_EVENT_CLOSE,
+} Profile_Event_Type;
+
+typedef struct Profile_Event Profile_Event;
+struct Profile_Event
+{
+  u64 timestamp;
+  u32 zone_index;
+  u32 type; // Profile_Event_Type
+};
+
+#define PROFILE_DEFAULT_EVENT_CAPACITY (1 << 20) // Per thread, 16 mb each
+
+// Only when sampling, see profile_enable_sampling()
+typedef struct Profile_Sample Profile_Sample;
+struct Profile_Sample
+{
+  u64 ip;
+  u64 zone_index;
+};
+
+// The itimer only fires on scheduler ticks, so past CONFIG_HZ (often 250 or 1000) asking for more does nothing
+#define PROFILE_DEFAULT_SAMPLE_RATE 1000
+#define PROFILE_SAMPLE_CAPACITY     (1 << 16) // Per thread ring, 1 mb each
+#define PROFILE_TOP_SAMPLE_IPS      10
+
+// What one empty pass costs, measured on a scratch profiler by begin_profiling(). A pass puts
+// inside_cycles into its own zone, and the rest of pass_cycles into whatever zone it is nested in
+typedef struct Profile_Overhead Profile_Overhead;
+struct Profile_Overhead
+{
+  f64 pass_cycles;   // begin through close
+  f64 inside_cycles; // Just between the two timer reads
+};
+
+// Zones where more than this much of their time is estimated to be the profiler get a warning
+#define PROFILE_OVERHEAD_WARN_PERCENT 5.0
+
+// Hardware counters at each pass, kept to the side so Profile_Pass stays small when they're off
+#define PROFILE_COUNTER_STACK_DEPTH 256
+
+typedef struct Profile_Counter_Frame Profile_Counter_Frame;
+struct Profile_Counter_Frame
+{
+  Perf_Counter_Values start;
+  Perf_Counter_Values old_inclusive;
 };
 
+// One per thread, made on the first pass a thread does and never shared, so passes never need atomics.
+// Zone indices are handed out process wide (see __profile_register_static_zone()) so they line up across
+// threads and can just be summed at the end
 typedef struct Profiler Profiler;
 struct Profiler
 {
-  // For the whole profiler duration
-  u64 start;
-
-  // DANGER! Needs to be a per thread profiler
   usize current_parent_zone;
+  u64   pass_count; // Closed ones
+
+  Profile_Zone zones[PROFILE_MAX_ZONES];
 
-  Profile_Zone zones[4096];
+  // Ring buffer, keeps the newest event_capacity (power of 2) events. NULL when not recording
+  Profile_Event *events;
+  usize         event_capacity;
+  usize         event_count; // Total ever recorded, so can tell how many got dropped
+
+  // Written by the signal handler on this thread, newest PROFILE_SAMPLE_CAPACITY kept. NULL when not sampling
+  Profile_Sample *samples;
+  usize          sample_count;
+
+  b32                   use_counters;
+  usize                 counter_depth;
+  Profile_Counter_Frame counter_stack[PROFILE_COUNTER_STACK_DEPTH];
+
+  // Only touched once when registering, and then by end_profiling()
+  Profiler *next;
+  usize    thread_index; // In order of first pass
+  String   thread_name;
 };
 
-static
+PROFILE_FUNCTION
 void begin_profiling();
 
-static
+// Any other threads that did passes need to be joined by now
+PROFILE_FUNCTION
 void end_profiling();
 
-static
-Profile_Pass __profile_begin_pass(String name, usize zone_index, u64 bytes_processed);
-
-static
+PROFILE_FUNCTION
+void __profile_set_thread_name(String name);
+
+// Optional, from then on every pass also records begin/close events for profile_write_chrome_trace()
+// Threads that already did passes only start recording once they call this themselves
+PROFILE_FUNCTION
+void profile_record_events(usize event_capacity);
+
+// After end_profiling(), writes everything still in the rings as Chrome trace json (chrome://tracing or ui.perfetto.dev)
+PROFILE_FUNCTION
+b32 profile_write_chrome_trace(String path);
+
+// After end_profiling(), appends a 'zone' record per zone (summed across threads, inclusive cycles) to
+// a results csv, see benchmark_results.h
+PROFILE_FUNCTION
+b32 profile_write_results(String path);
+
+// Optional, every pass also reads the hardware counters (see perf_counters_open()) and each zone sums
+// up the deltas. Costs a good bit more per pass than the timer alone, especially without rdpmc. Returns
+// false if called from inside a pass
+PROFILE_FUNCTION
+b32 profile_enable_counters(void);
+
+// Optional, a SIGPROF timer on process cpu time that notes the innermost zone and instruction pointer of
+// whichever thread was running. end_profiling() then puts the sampled share of each zone next to its
+// instrumented share and lists the hottest addresses, so the cost of the instrumentation itself shows up
+// as the difference. Linux only, and takes over SIGPROF and ITIMER_PROF
+PROFILE_FUNCTION
+b32 profile_enable_sampling(u32 samples_per_second);
+
+// Once per call site, the index then gets cached in a static at the site
+PROFILE_FUNCTION
+u32 __profile_register_static_zone(u32 *slot, String name);
+
+// Same name always gives the same zone, from any thread or translation unit. The name gets copied.
+// For zones that depend on data, like per depth or per test entry. Costs a hash and a probe per call,
+// so for hot loops look it up once and use profile_begin_zone_pass()
+PROFILE_FUNCTION
+u32 profile_zone_named(String name);
+
+PROFILE_FUNCTION
+Profile_Pass __profile_begin_pass(usize zone_index, u64 bytes_processed);
+
+PROFILE_FUNCTION
 void __profile_close_pass(Profile_Pass pass);
 
 // TODO: Can redo the PROFILE_SCOPE macro to use a member from pass to check scope
 
 #ifdef PROFILE
-  // Only works for unity builds, but I do those anyways
-  #define profile_begin_pass(name) __profile_begin_pass(String(name), __COUNTER__ + 1, 0) // First zone is never used, so the default parent 0 doesn't get junk info
+  // Each call site keeps its zone in a static, so after the first hit this is a load and the indexed stores
+  #define __profile_static_zone(name) \
+    ({ static u32 __zone_slot; u32 __zone = __atomic_load_n(&__zone_slot, __ATOMIC_RELAXED); __zone ? __zone : __profile_register_static_zone(&__zone_slot, String(name)); })
+
+  #define profile_begin_pass(name) __profile_begin_pass(__profile_static_zone(name), 0)
   #define profile_close_pass(block)  __profile_close_pass(block)
 
+  // Zone from profile_zone_named(), name is a String
+  #define profile_begin_zone_pass(zone_index, bytes) __profile_begin_pass((zone_index), (bytes))
+  #define profile_begin_named_pass(name)             __profile_begin_pass(profile_zone_named(name), 0)
+
+  // Optional, what the thread gets called in the per thread report
+  #define profile_set_thread_name(name) __profile_set_thread_name(String(name))
+
   // Helpful, and ok to hardcode name since should only use these once per function scope
   #define profile_begin_func() Profile_Pass __func_pass__ = profile_begin_pass(__func__)
   #define profile_close_func()   profile_close_pass(__func_pass__)
@@ -64,15 +216,27 @@ void __profile_close_pass(Profile_Pass pass);
     Profile_Pass CONCAT(__pass, __LINE__) = profile_begin_pass(name); DEFER_SCOPE(VOID_PROC, profile_close_pass(CONCAT(__pass, __LINE__)))
 
   #define PROFILE_SCOPE_BANDWIDTH(name, bytes) \
-    Profile_Pass CONCAT(__pass, __LINE__) = __profile_begin_pass(String(name), __COUNTER__ + 1, bytes); DEFER_SCOPE(VOID_PROC, profile_close_pass(CONCAT(__pass, __LINE__)))
+    Profile_Pass CONCAT(__pass, __LINE__) = __profile_begin_pass(__profile_static_zone(name), bytes); DEFER_SCOPE(VOID_PROC, profile_close_pass(CONCAT(__pass, __LINE__)))
+
+  // Runtime names, see profile_zone_named()
+  #define PROFILE_SCOPE_NAMED(name) \
+    Profile_Pass CONCAT(__pass, __LINE__) = profile_begin_named_pass(name); DEFER_SCOPE(VOID_PROC, profile_close_pass(CONCAT(__pass, __LINE__)))
+
+  #define PROFILE_SCOPE_NAMED_BANDWIDTH(name, bytes) \
+    Profile_Pass CONCAT(__pass, __LINE__) = __profile_begin_pass(profile_zone_named(name), bytes); DEFER_SCOPE(VOID_PROC, profile_close_pass(CONCAT(__pass, __LINE__)))
 
 #else
   #define profile_begin_pass(name)  VOID_PROC
+  #define profile_begin_zone_pass(zone_index, bytes) VOID_PROC
+  #define profile_begin_named_pass(name) VOID_PROC
   #define profile_close_pass(block) VOID_PROC
+  #define profile_set_thread_name(name) VOID_PROC
   #define profile_begin_func()      VOID_PROC
   #define profile_close_func()      VOID_PROC
   #define PROFILE_SCOPE(name)
   #define PROFILE_SCOPE_BANDWIDTH(name, bytes)
+  #define PROFILE_SCOPE_NAMED(name)
+  #define PROFILE_SCOPE_NAMED_BANDWIDTH(name, bytes)
 #endif
 
 #endif // PROFILE_H
@@ -2,11 +2,27 @@
 
 #include "platform_timing.h"
 
+// NULL unless repetition_tester_record_results()
+static FILE *g_reptest_results;
+
+// 0 unless repetition_tester_stop_on_confidence()
+static f64 g_reptest_confidence_tolerance;
+
 static
 void repetition_tester_begin_time(Repetition_Tester *tester)
 {
   Repetition_Test *curr = &tester->current_test;
   curr->begin_block_count += 1;
+
+  if (tester->use_counters)
+  {
+    Perf_Counter_Values counters = read_perf_counters();
+    for (usize i = 0; i < PERF_COUNTER_COUNT; i++)
+    {
+      curr->accum.v[REPTEST_VALUE_PERF_FIRST + i] -= counters.v[i];
+    }
+  }
+
   curr->accum.v[REPTEST_VALUE_TIME] -= read_cpu_timer();
   curr->accum.v[REPTEST_VALUE_PAGE_FAULTS]  -= read_os_page_faults();
 }
@@ -17,6 +33,16 @@ void repetition_tester_close_time(Repetition_Tester *tester)
   Repetition_Test *curr = &tester->current_test;
   curr->accum.v[REPTEST_VALUE_TIME] += read_cpu_timer();
   curr->accum.v[REPTEST_VALUE_PAGE_FAULTS] += read_os_page_faults();
+
+  if (tester->use_counters)
+  {
+    Perf_Counter_Values counters = read_perf_counters();
+    for (usize i = 0; i < PERF_COUNTER_COUNT; i++)
+    {
+      curr->accum.v[REPTEST_VALUE_PERF_FIRST + i] += counters.v[i];
+    }
+  }
+
   curr->close_block_count += 1;
 }
 
@@ -49,7 +75,8 @@ void repetition_tester_error(Repetition_Tester *tester, const char *message)
 }
 
 static
-void print_repetition_test_values(const char *label, Repetition_Test_Values values, u64 cpu_timer_frequency, u64 test_count)
+void print_repetition_test_values(const char *label, Repetition_Test_Values values, u64 cpu_timer_frequency, u64 test_count,
+                                  Latency_Histogram *histogram)
 {
   u64 divisor = test_count ? test_count : 1;
 
@@ -88,6 +115,224 @@ void print_repetition_test_values(const char *label, Repetition_Test_Values valu
       printf(", %lu memops", memops);
     }
   }
+
+  for (usize i = 0; i < PERF_COUNTER_COUNT; i++)
+  {
+    u64 count = values.v[REPTEST_VALUE_PERF_FIRST + i] / divisor;
+    if (count)
+    {
+      printf(", %lu %s", count, perf_counter_name(i));
+    }
+  }
+
+  u64 core_cycles  = values.v[REPTEST_VALUE_CORE_CYCLES];
+  u64 instructions = values.v[REPTEST_VALUE_INSTRUCTIONS];
+  if (core_cycles && instructions)
+  {
+    printf(" (%.2f ipc)", (f64)instructions / (f64)core_cycles);
+  }
+
+  // Callers end the line themselves so this goes on its own line before that
+  if (histogram && histogram->count)
+  {
+    printf("\n");
+    print_latency_histogram_percentiles("     ", histogram);
+    printf(" (%lu tests)", histogram->count);
+  }
+}
+
+// Spins since tests want to start as close together as they can, yields now and then in case there are
+// more threads than cores
+static
+void repetition_group_barrier(Repetition_Group *group)
+{
+  usize generation = __atomic_load_n(&group->generation, __ATOMIC_ACQUIRE);
+
+  if (__atomic_add_fetch(&group->arrived, 1, __ATOMIC_ACQ_REL) == group->thread_count)
+  {
+    __atomic_store_n(&group->arrived, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&group->generation, generation + 1, __ATOMIC_RELEASE);
+  }
+  else
+  {
+    for (usize spins = 1; __atomic_load_n(&group->generation, __ATOMIC_ACQUIRE) == generation; spins++)
+    {
+      _mm_pause();
+      if (!(spins % 1024))
+      {
+        sched_yield();
+      }
+    }
+  }
+}
+
+// Between every test. Testers that are done keep running their function so the load stays the same for
+// the ones still going, until everyone is done
+static
+b32 repetition_group_sync(Repetition_Tester *tester, b32 testing)
+{
+  Repetition_Group *group = tester->group;
+
+  if (!testing && !tester->group_done)
+  {
+    tester->group_done = true;
+    __atomic_add_fetch(&group->done_count, 1, __ATOMIC_RELEASE);
+  }
+
+  // Everyone is through the test they were on, and has counted themselves if done
+  repetition_group_barrier(group);
+
+  if (tester->group_index == 0 && group->test_start)
+  {
+    group->min_wall_time = MIN(group->min_wall_time, read_cpu_timer() - group->test_start);
+  }
+
+  b32 all_done = __atomic_load_n(&group->done_count, __ATOMIC_ACQUIRE) == group->thread_count;
+
+  // Nobody counts themselves done again until everyone has looked
+  repetition_group_barrier(group);
+
+  if (tester->group_index == 0)
+  {
+    group->test_start = read_cpu_timer();
+  }
+
+  return !all_done;
+}
+
+static
+b32 repetition_tester_record_results(String path)
+{
+  if (g_reptest_results)
+  {
+    fclose(g_reptest_results);
+  }
+
+  g_reptest_results = benchmark_results_open(path);
+
+  return g_reptest_results != NULL;
+}
+
+static
+void repetition_tester_write_record(Repetition_Tester *tester)
+{
+  Repetition_Tester_Results *results = &tester->results;
+
+  Benchmark_Record record =
+  {
+    .kind       = String("test"),
+    .name       = tester->name.count ? tester->name : String("test"),
+    .count      = results->test_count,
+    .min_cycles = results->min.v[REPTEST_VALUE_TIME],
+    .avg_cycles = results->test_count ? results->total.v[REPTEST_VALUE_TIME] / results->test_count : 0,
+    .max_cycles = results->max.v[REPTEST_VALUE_TIME],
+    .bytes      = results->min.v[REPTEST_VALUE_BYTE_COUNT],
+    .cpu_timer_frequency = tester->cpu_timer_frequency,
+  };
+  for (usize i = 0; i < PERF_COUNTER_COUNT; i++)
+  {
+    record.counters[i] = results->min.v[REPTEST_VALUE_PERF_FIRST + i];
+  }
+
+  benchmark_results_write(g_reptest_results, &record);
+  fflush(g_reptest_results);
+}
+
+static
+void repetition_tester_stop_on_confidence(f64 relative_tolerance)
+{
+  g_reptest_confidence_tolerance = relative_tolerance > 0.0 ? relative_tolerance : 0.0;
+}
+
+static
+int repetition_compare_u64(const void *a, const void *b)
+{
+  u64 x = *(const u64 *)a;
+  u64 y = *(const u64 *)b;
+
+  return (x > y) - (x < y);
+}
+
+// Only ever slower, the timer doesn't change rate so interrupts, migrations and the clock dropping all
+// just make a test take longer. Faster tests are the thing we are looking for
+static
+b32 repetition_confidence_is_outlier(Repetition_Confidence *confidence, u64 time, f64 tolerance)
+{
+  b32 result = false;
+
+  if (confidence->window_count >= REPTEST_CONFIDENCE_MIN_TESTS)
+  {
+    // Don't let a very steady test make everything slightly slower an outlier
+    f64 deviation = MAX((f64)confidence->deviation, tolerance * (f64)confidence->median);
+
+    result = (f64)time > (f64)confidence->median + REPTEST_OUTLIER_DEVIATIONS * deviation;
+  }
+
+  return result;
+}
+
+// Returns whether the estimates are now within tolerance
+static
+b32 repetition_confidence_add(Repetition_Confidence *confidence, u64 time, u64 test_count, f64 tolerance)
+{
+  confidence->window[confidence->window_at] = time;
+  confidence->window_at = (confidence->window_at + 1) % REPTEST_CONFIDENCE_WINDOW;
+  confidence->window_count = MIN(confidence->window_count + 1, REPTEST_CONFIDENCE_WINDOW);
+
+  // Small improvements to the min don't mean it's still moving
+  if (!confidence->stable_min || (f64)time < (1.0 - tolerance) * (f64)confidence->stable_min)
+  {
+    confidence->stable_min      = time;
+    confidence->stable_min_test = test_count;
+  }
+  confidence->stable_min = MIN(confidence->stable_min, time);
+
+  usize count = confidence->window_count;
+
+  u64 sorted[REPTEST_CONFIDENCE_WINDOW];
+  MEM_COPY(sorted, confidence->window, count * sizeof(u64));
+  qsort(sorted, count, sizeof(u64), repetition_compare_u64);
+
+  confidence->median = sorted[count / 2];
+
+  // Distribution free, the ranks either side of the middle that hold the median 95% of the time
+  f64 spread = 1.96 * sqrt((f64)count) / 2.0;
+  i64 low  = (i64)floor((f64)count / 2.0 - spread);
+  i64 high = (i64)ceil((f64)count / 2.0 + spread);
+
+  confidence->median_low  = sorted[CLAMP(low, 0, (i64)count - 1)];
+  confidence->median_high = sorted[CLAMP(high, 0, (i64)count - 1)];
+
+  // Reuse for the absolute deviations, only need their median
+  for (usize i = 0; i < count; i++)
+  {
+    sorted[i] = sorted[i] > confidence->median ? sorted[i] - confidence->median : confidence->median - sorted[i];
+  }
+  qsort(sorted, count, sizeof(u64), repetition_compare_u64);
+
+  confidence->deviation = (u64)(1.4826 * (f64)sorted[count / 2]);
+
+  f64 half_width = (f64)(confidence->median_high - confidence->median_low) / 2.0 / (f64)confidence->median;
+
+  b32 result = count >= REPTEST_CONFIDENCE_MIN_TESTS &&
+               half_width <= tolerance &&
+               test_count - confidence->stable_min_test >= REPTEST_CONFIDENCE_MIN_TESTS;
+
+  return result;
+}
+
+static
+void print_repetition_confidence(Repetition_Confidence *confidence, u64 cpu_timer_frequency, f64 tolerance)
+{
+  f64 half_width = confidence->median ? 50.0 * (f64)(confidence->median_high - confidence->median_low) / (f64)confidence->median : 0.0;
+
+  printf("MEDIAN: %lu (%.4fms) +-%.2f%% at 95%% confidence, %lu outliers thrown out", confidence->median,
+         1000.0 * cpu_time_in_seconds(confidence->median, cpu_timer_frequency), half_width, confidence->outlier_count);
+
+  if (!confidence->converged)
+  {
+    printf(", WARNING: hit the time cap before settling within %.2f%%", 100.0 * tolerance);
+  }
 }
 
 static
@@ -99,6 +344,7 @@ void repetition_tester_new_wave(Repetition_Tester *tester, u64 target_processed_
     tester->target_processed_byte_count = target_processed_byte_count;
     tester->cpu_timer_frequency = cpu_timer_frequency;
     tester->results.min.v[REPTEST_VALUE_TIME] = (u64)-1;
+    tester->use_counters = perf_counters_open();
   }
   else if (tester->mode == REPTEST_MODE_COMPLETE)
   {
@@ -117,6 +363,9 @@ void repetition_tester_new_wave(Repetition_Tester *tester, u64 target_processed_
 
   tester->try_for_min_time = seconds_to_try_for_min * cpu_timer_frequency;
   tester->tests_start_time = read_cpu_timer();
+  tester->wave_start_time  = tester->tests_start_time;
+
+  tester->confidence = (Repetition_Confidence){0};
 }
 
 static
@@ -143,58 +392,245 @@ b32 repetition_tester_is_testing(Repetition_Tester *tester)
 
       if (tester->mode == REPTEST_MODE_TESTING) // We are all good no errors from previous checks
       {
-        Repetition_Tester_Results *results = &tester->results;
-        results->test_count += 1;
+        Repetition_Tester_Results *results    = &tester->results;
+        Repetition_Confidence     *confidence = &tester->confidence;
 
-        for (usize i = 0; i < STATIC_ARRAY_COUNT(results->total.v); i++)
-        {
-          results->total.v[i] += curr.accum.v[i];
-        }
+        f64 tolerance = g_reptest_confidence_tolerance;
+
+        u64 time = curr.accum.v[REPTEST_VALUE_TIME];
 
-        if (curr.accum.v[REPTEST_VALUE_TIME] > results->max.v[REPTEST_VALUE_TIME])
+        if (tolerance && repetition_confidence_is_outlier(confidence, time, tolerance))
         {
-          results->max = curr.accum;
+          confidence->outlier_count += 1;
         }
-
-        // Have some special stuff to do if we find a new min
-        if (curr.accum.v[REPTEST_VALUE_TIME] < results->min.v[REPTEST_VALUE_TIME])
+        else
         {
-          results->min = curr.accum;
+          results->test_count += 1;
+
+          for (usize i = 0; i < STATIC_ARRAY_COUNT(results->total.v); i++)
+          {
+            results->total.v[i] += curr.accum.v[i];
+          }
 
-          // Restart time to find new min
-          tester->tests_start_time = current_time;
+          latency_histogram_add(&results->time_histogram, time);
+
+          if (time > results->max.v[REPTEST_VALUE_TIME])
+          {
+            results->max = curr.accum;
+          }
 
-          printf("                                                                                        \r");
-          print_repetition_test_values("MIN", results->min, tester->cpu_timer_frequency, 1);
-          printf("\r");
-          fflush(stdout);
+          // Have some special stuff to do if we find a new min
+          if (time < results->min.v[REPTEST_VALUE_TIME])
+          {
+            results->min = curr.accum;
+
+            // Restart time to find new min
+            tester->tests_start_time = current_time;
+
+            if (!tester->quiet)
+            {
+              printf("                                                                                        \r");
+              print_repetition_test_values("MIN", results->min, tester->cpu_timer_frequency, 1, NULL);
+              printf("\r");
+              fflush(stdout);
+            }
+          }
+
+          if (tolerance)
+          {
+            confidence->converged = repetition_confidence_add(confidence, time, results->test_count, tolerance);
+          }
         }
 
         // Reset
         tester->current_test = (Repetition_Test){0};
 
-        // Now check if long enough time has passed without finding a new min
-        if ((current_time - tester->tests_start_time) > tester->try_for_min_time)
+        // Now check if long enough time has passed without finding a new min, or if we are sure enough
+        b32 done = false;
+        if (tolerance)
+        {
+          done = confidence->converged || (current_time - tester->wave_start_time) > tester->try_for_min_time;
+        }
+        else
+        {
+          done = (current_time - tester->tests_start_time) > tester->try_for_min_time;
+        }
+
+        if (done)
         {
           tester->mode = REPTEST_MODE_COMPLETE;
 
-          print_repetition_test_values("MIN", results->min, tester->cpu_timer_frequency, 1);
-          printf("\n");
+          if (!tester->quiet)
+          {
+            print_repetition_test_values("MIN", results->min, tester->cpu_timer_frequency, 1, NULL);
+            printf("\n");
 
-          print_repetition_test_values("MAX", results->max, tester->cpu_timer_frequency, 1);
-          printf("\n");
+            print_repetition_test_values("MAX", results->max, tester->cpu_timer_frequency, 1, NULL);
+            printf("\n");
+          }
 
-          if (results->test_count)
+          if (results->test_count && !tester->quiet)
           {
             printf("                                                          \r");
             fflush(stdout);
-            print_repetition_test_values("AVG", results->total, tester->cpu_timer_frequency, results->test_count);
+            print_repetition_test_values("AVG", results->total, tester->cpu_timer_frequency, results->test_count, &results->time_histogram);
             printf("\n");
+
+            if (tolerance)
+            {
+              print_repetition_confidence(confidence, tester->cpu_timer_frequency, tolerance);
+              printf("\n");
+            }
+          }
+
+          if (g_reptest_results)
+          {
+            repetition_tester_write_record(tester);
           }
         }
       }
     }
   }
 
-  return tester->mode == REPTEST_MODE_TESTING;
+  b32 testing = tester->mode == REPTEST_MODE_TESTING;
+  if (tester->group)
+  {
+    testing = repetition_group_sync(tester, testing);
+  }
+
+  return testing;
+}
+
+typedef struct Repetition_Parallel_Worker Repetition_Parallel_Worker;
+struct Repetition_Parallel_Worker
+{
+  Repetition_Parallel_Wave *wave;
+  Repetition_Group         *group;
+  usize                    index;
+};
+
+// Waits for the go ahead so nobody gets stuck in a barrier if a thread can't be launched
+static
+void *repetition_parallel_worker(void *params)
+{
+  Repetition_Parallel_Worker *worker = (Repetition_Parallel_Worker *)params;
+  Repetition_Parallel_Wave   *wave   = worker->wave;
+
+  usize start = 0;
+  while (!(start = __atomic_load_n(&worker->group->start, __ATOMIC_ACQUIRE)))
+  {
+    sched_yield();
+  }
+
+  if (start == REPTEST_GROUP_GO)
+  {
+    usize cpu = wave->cpus ? wave->cpus[worker->index] : worker->index % os_get_cpu_count();
+    os_thread_pin_to_cpu(cpu);
+
+    Repetition_Tester *tester = wave->testers + worker->index;
+    repetition_tester_new_wave(tester, wave->target_processed_byte_count, wave->cpu_timer_frequency, wave->seconds_to_try_for_min);
+
+    wave->function(tester, wave->params[worker->index]);
+  }
+
+  return NULL;
+}
+
+static
+b32 repetition_tester_parallel_wave(Repetition_Parallel_Wave *wave)
+{
+  if (!wave->thread_count || wave->thread_count > REPTEST_MAX_THREADS)
+  {
+    LOG_ERROR("Parallel wave needs 1 to %d threads, not %lu", REPTEST_MAX_THREADS, wave->thread_count);
+    return false;
+  }
+
+  Repetition_Group group =
+  {
+    .thread_count  = wave->thread_count,
+    .min_wall_time = UINT64_MAX,
+  };
+
+  Repetition_Parallel_Worker workers[REPTEST_MAX_THREADS] = {0};
+  OS_Thread                  threads[REPTEST_MAX_THREADS] = {0};
+
+  for (usize i = 0; i < wave->thread_count; i++)
+  {
+    Repetition_Tester *tester = wave->testers + i;
+    tester->quiet       = true;
+    tester->group       = &group;
+    tester->group_index = i;
+    tester->group_done  = false;
+
+    workers[i] = (Repetition_Parallel_Worker){.wave = wave, .group = &group, .index = i};
+  }
+
+  b32 launched = true;
+  for (usize i = 0; i < wave->thread_count; i++)
+  {
+    threads[i] = os_thread_launch(repetition_parallel_worker, workers + i);
+    launched &= threads[i].handle != 0;
+  }
+
+  __atomic_store_n(&group.start, launched ? REPTEST_GROUP_GO : REPTEST_GROUP_ABORT, __ATOMIC_RELEASE);
+
+  for (usize i = 0; i < wave->thread_count; i++)
+  {
+    os_thread_join(threads[i]);
+    wave->testers[i].group = NULL;
+  }
+
+  wave->min_wall_time = group.min_wall_time != UINT64_MAX ? group.min_wall_time : 0;
+
+  return launched;
+}
+
+static
+f64 repetition_parallel_wave_gb_per_s(Repetition_Parallel_Wave *wave)
+{
+  f64 result = 0.0;
+
+  for (usize i = 0; i < wave->thread_count; i++)
+  {
+    Repetition_Test_Values min = wave->testers[i].results.min;
+
+    f64 seconds = cpu_time_in_seconds(min.v[REPTEST_VALUE_TIME], wave->cpu_timer_frequency);
+    if (seconds > 0.0)
+    {
+      result += (f64)min.v[REPTEST_VALUE_BYTE_COUNT] / (f64)GB(1) / seconds;
+    }
+  }
+
+  return result;
+}
+
+static
+f64 repetition_parallel_wave_wall_gb_per_s(Repetition_Parallel_Wave *wave)
+{
+  u64 byte_count = 0;
+  for (usize i = 0; i < wave->thread_count; i++)
+  {
+    byte_count += wave->testers[i].results.min.v[REPTEST_VALUE_BYTE_COUNT];
+  }
+
+  f64 seconds = cpu_time_in_seconds(wave->min_wall_time, wave->cpu_timer_frequency);
+
+  return seconds > 0.0 ? (f64)byte_count / (f64)GB(1) / seconds : 0.0;
+}
+
+static
+void print_repetition_parallel_wave(Repetition_Parallel_Wave *wave)
+{
+  for (usize i = 0; i < wave->thread_count; i++)
+  {
+    usize cpu = wave->cpus ? wave->cpus[i] : i % os_get_cpu_count();
+
+    printf("Thread %lu (cpu %lu) ", i, cpu);
+    print_repetition_test_values("MIN", wave->testers[i].results.min, wave->cpu_timer_frequency, 1, NULL);
+    printf("\n");
+  }
+
+  printf("TOTAL: %.4f GB/s summed over threads, %.4f GB/s over the wall clock (%.4fms)\n",
+         repetition_parallel_wave_gb_per_s(wave), repetition_parallel_wave_wall_gb_per_s(wave),
+         1000.0 * cpu_time_in_seconds(wave->min_wall_time, wave->cpu_timer_frequency));
 }
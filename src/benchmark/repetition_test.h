@@ -2,6 +2,8 @@
 #define REPETITION_TEST_H
 
 #include "platform_timing.h"
+#include "latency_histogram.h"
+#include "benchmark_results.h"
 
 typedef enum Repetition_Tester_Mode
 {
@@ -24,9 +26,19 @@ typedef enum Repetition_Test_Value
   REPTEST_VALUE_FLOP_COUNT,
   REPTEST_VALUE_MEMOP_COUNT,
 
+  // Hardware counters, same order as Perf_Counter. Stay 0 if the machine won't give them to us
+  REPTEST_VALUE_CORE_CYCLES,
+  REPTEST_VALUE_INSTRUCTIONS,
+  REPTEST_VALUE_L1D_MISSES,
+  REPTEST_VALUE_LLC_MISSES,
+  REPTEST_VALUE_BRANCH_MISSES,
+  REPTEST_VALUE_DTLB_MISSES,
+
   REPTEST_VALUE_COUNT,
 } Repetition_Test_Value;
 
+#define REPTEST_VALUE_PERF_FIRST REPTEST_VALUE_CORE_CYCLES
+
 typedef struct Repetition_Test_Values Repetition_Test_Values;
 struct Repetition_Test_Values
 {
@@ -48,6 +60,56 @@ struct Repetition_Tester_Results
   Repetition_Test_Values min;
   Repetition_Test_Values max;
   Repetition_Test_Values total;
+
+  Latency_Histogram time_histogram; // Every test's time, not just min and max
+};
+
+// Only used when stopping on confidence, see repetition_tester_stop_on_confidence()
+#define REPTEST_CONFIDENCE_WINDOW    256 // Most recent kept test times the estimates come from
+#define REPTEST_CONFIDENCE_MIN_TESTS 16  // Tests before anything is stable or an outlier
+#define REPTEST_OUTLIER_DEVIATIONS   5.0 // How far past the median, in robust standard deviations, is an outlier
+
+typedef struct Repetition_Confidence Repetition_Confidence;
+struct Repetition_Confidence
+{
+  u64   window[REPTEST_CONFIDENCE_WINDOW]; // Ring of kept test times
+  usize window_count;
+  usize window_at;
+
+  u64 stable_min;      // Min as of the last time it dropped by more than the tolerance
+  u64 stable_min_test; // Test count at that point
+
+  // Kept up to date as tests come in, from the window
+  u64 median;
+  u64 median_low;  // 95% confidence interval of the median
+  u64 median_high;
+  u64 deviation;   // Median absolute deviation, scaled to match a standard deviation
+
+  u64 outlier_count;
+  b32 converged;   // Otherwise the time cap stopped it
+};
+
+#define REPTEST_GROUP_GO    1
+#define REPTEST_GROUP_ABORT 2
+
+// Testers running together in a parallel wave, all of them start each test at the same time and keep
+// going until every one of them is done. See repetition_tester_parallel_wave()
+typedef struct Repetition_Group Repetition_Group;
+struct Repetition_Group
+{
+  usize thread_count;
+
+  // Spinning barrier
+  usize arrived;
+  usize generation;
+
+  usize done_count; // Testers that have finished, the rest keep the load on until then
+
+  usize start; // REPTEST_GROUP_GO once every thread is launched
+
+  // Only touched by thread 0
+  u64 test_start;
+  u64 min_wall_time;
 };
 
 typedef struct Repetition_Tester Repetition_Tester;
@@ -55,13 +117,27 @@ struct Repetition_Tester
 {
   u64 target_processed_byte_count;
   u64 cpu_timer_frequency;
-  u64 try_for_min_time;
+  u64 try_for_min_time; // Time cap instead when stopping on confidence
   u64 tests_start_time;
+  u64 wave_start_time;
 
   Repetition_Tester_Mode mode;
 
+  b32 use_counters; // Opened on the first wave, for whatever thread runs the tests
+
+  String name; // Optional, what it gets called in recorded results
+
+  b32 quiet; // No printing while testing
+
+  // Only in parallel waves
+  Repetition_Group *group;
+  usize            group_index;
+  b32              group_done;
+
   Repetition_Test current_test;
   Repetition_Tester_Results results;
+
+  Repetition_Confidence confidence; // Reset every wave
 };
 
 static
@@ -81,9 +157,10 @@ void repetition_tester_count_memops(Repetition_Tester *tester, u64 count);
 static
 void repetition_tester_error(Repetition_Tester *tester, const char *message);
 
+// Histogram is optional, adds a line of percentiles
 static
 void print_repetition_test_values(const char *label, Repetition_Test_Values values,
-                                  u64 cpu_timer_frequency, u64 test_count);
+                                  u64 cpu_timer_frequency, u64 test_count, Latency_Histogram *histogram);
 
 static
 void repetition_tester_new_wave(Repetition_Tester *tester, u64 target_processed_byte_count,
@@ -92,6 +169,18 @@ void repetition_tester_new_wave(Repetition_Tester *tester, u64 target_processed_
 static
 b32 repetition_tester_is_testing(Repetition_Tester *tester);
 
+// Optional, from then on every wave that completes appends a 'test' record (min/avg/max time, bytes
+// and counters from the min run) to the results csv, see benchmark_results.h
+static
+b32 repetition_tester_record_results(String path);
+
+// Optional, from then on waves run until the median test time is known within relative_tolerance
+// (0.01 for 1%) at 95% confidence and the min has stopped moving by more than that, with
+// seconds_to_try_for_min as a cap instead. Tests much slower than the rest (interrupts, the clock
+// dropping) are thrown out. 0 goes back to stopping once there hasn't been a new min for a while
+static
+void repetition_tester_stop_on_confidence(f64 relative_tolerance);
+
 // You provide the definitions for these
 typedef struct Operation_Parameters Operation_Parameters;
 typedef void Operation_Function(Repetition_Tester *tester, Operation_Parameters *params);
@@ -103,4 +192,41 @@ struct Operation_Entry
   Operation_Function *function;
 };
 
+// Same function on thread_count threads at once, each pinned to a cpu and with its own params (and
+// so its own buffers). Tests start together off a barrier so the threads really fight over the shared
+// caches and memory. Testers stay quiet while running, print_repetition_parallel_wave() after
+typedef struct Repetition_Parallel_Wave Repetition_Parallel_Wave;
+struct Repetition_Parallel_Wave
+{
+  Operation_Function    *function;
+  Operation_Parameters **params;       // thread_count of them
+  Repetition_Tester     *testers;      // thread_count of them, zeroed
+  usize                  thread_count;
+  usize                 *cpus;         // Optional, otherwise thread i goes on cpu i, wrapping around
+
+  u64 target_processed_byte_count; // Per thread
+  u64 cpu_timer_frequency;
+  u32 seconds_to_try_for_min;
+
+  // Filled in, fastest test from all threads starting to the last one finishing
+  u64 min_wall_time;
+};
+
+#define REPTEST_MAX_THREADS 256
+
+static
+b32 repetition_tester_parallel_wave(Repetition_Parallel_Wave *wave);
+
+// Each thread's min, then the sum of those and the bandwidth over the wall clock of the fastest test
+static
+void print_repetition_parallel_wave(Repetition_Parallel_Wave *wave);
+
+// Sum of each thread's best bytes per second, in gb/s
+static
+f64 repetition_parallel_wave_gb_per_s(Repetition_Parallel_Wave *wave);
+
+// All threads' bytes over the wall clock of the fastest test, in gb/s
+static
+f64 repetition_parallel_wave_wall_gb_per_s(Repetition_Parallel_Wave *wave);
+
 #endif // REPETITION_TEST_H
@@ -0,0 +1,184 @@
+#define LOG_TITLE "COMPARE"
+#define COMMON_IMPLEMENTATION
+#include "common.h"
+
+#include "benchmark/benchmark_inc.h"
+#include "benchmark/benchmark_inc.c"
+
+#define DESIRED_POSITIONAL_COUNT 2
+
+// Never call anything within this much a regression, however quiet the runs were
+#define DEFAULT_THRESHOLD_PERCENT 5
+
+// How much of the min to max spread counts as noise. Max is usually a cold or interrupted run, so only a bit of it
+#define DEFAULT_SPREAD_PERCENT 10
+
+// Every record with the same kind and name, across however many runs are in the file
+typedef struct Compare_Entry Compare_Entry;
+struct Compare_Entry
+{
+  String kind;
+  String name;
+  usize  runs;
+  u64    best;  // Lowest min_cycles
+  u64    worst; // Highest max_cycles
+};
+
+static
+Compare_Entry *find_entry(Compare_Entry *entries, usize entry_count, String kind, String name)
+{
+  Compare_Entry *result = NULL;
+
+  for (usize i = 0; i < entry_count; i++)
+  {
+    if (string_match(entries[i].kind, kind) && string_match(entries[i].name, name))
+    {
+      result = entries + i;
+      break;
+    }
+  }
+
+  return result;
+}
+
+static
+usize load_results(Arena *arena, String path, Compare_Entry **out_entries)
+{
+  String file = read_file_to_arena(arena, path);
+  if (!file.count)
+  {
+    LOG_ERROR("No results in '%.*s'", String_Format(path));
+    return 0;
+  }
+
+  usize line_count = 1;
+  for (usize i = 0; i < file.count; i++)
+  {
+    line_count += file.v[i] == '\n';
+  }
+
+  Compare_Entry *entries = arena_calloc(arena, line_count, Compare_Entry);
+  usize entry_count = 0;
+
+  usize line_start = 0;
+  for (usize i = 0; i <= file.count; i++)
+  {
+    if (i < file.count && file.v[i] != '\n')
+    {
+      continue;
+    }
+
+    String line = string_substring(file, line_start, i);
+    line_start = i + 1;
+
+    Benchmark_Record record = {0};
+    if (!benchmark_results_parse(line, &record))
+    {
+      continue;
+    }
+
+    Compare_Entry *entry = find_entry(entries, entry_count, record.kind, record.name);
+    if (!entry)
+    {
+      entry = entries + entry_count;
+      entry_count += 1;
+
+      entry->kind  = record.kind;
+      entry->name  = record.name;
+      entry->best  = UINT64_MAX;
+      entry->worst = 0;
+    }
+
+    entry->runs  += 1;
+    entry->best  = MIN(entry->best, record.min_cycles);
+    entry->worst = MAX(entry->worst, record.max_cycles);
+  }
+
+  *out_entries = entries;
+  return entry_count;
+}
+
+static
+f64 entry_spread_percent(Compare_Entry *entry)
+{
+  return entry->best ? 100.0 * (f64)(entry->worst - entry->best) / (f64)entry->best : 0.0;
+}
+
+int main(int args_count, char **args)
+{
+  Arena arena = arena_make();
+
+  Args arguments = parse_args(&arena, args_count, args);
+
+  if (arguments.positionals_count != DESIRED_POSITIONAL_COUNT)
+  {
+    printf("Usage: %s [baseline_csv] [current_csv] [--threshold=percent] [--spread=percent]\n"
+           "  Compares the best cycles of each zone or test, exits with 1 if anything got slower by more than\n"
+           "  max(threshold, spread%% of the min to max spread in either file)\n", args[0]);
+    return 2;
+  }
+
+  f64 threshold_floor = (f64)args_get_integer_value(&arguments, String("threshold"), DEFAULT_THRESHOLD_PERCENT);
+  f64 spread_fraction = (f64)args_get_integer_value(&arguments, String("spread"), DEFAULT_SPREAD_PERCENT) / 100.0;
+
+  Compare_Entry *baseline = NULL;
+  Compare_Entry *current  = NULL;
+  usize baseline_count = load_results(&arena, arguments.positionals[0], &baseline);
+  usize current_count  = load_results(&arena, arguments.positionals[1], &current);
+
+  if (!baseline_count || !current_count)
+  {
+    return 2;
+  }
+
+  usize regressions  = 0;
+  usize improvements = 0;
+
+  printf("%-6s %-40s %14s %14s %9s %10s  %s\n", "kind", "name", "baseline", "current", "change", "threshold", "result");
+  for (usize i = 0; i < baseline_count; i++)
+  {
+    Compare_Entry *base = baseline + i;
+    Compare_Entry *curr = find_entry(current, current_count, base->kind, base->name);
+
+    if (!curr)
+    {
+      printf("%-6.*s %-40.*s %14lu %14s %9s %10s  missing\n", String_Format(base->kind), String_Format(base->name), base->best, "-", "-", "-");
+      continue;
+    }
+
+    f64 change = base->best ? 100.0 * ((f64)curr->best - (f64)base->best) / (f64)base->best : 0.0;
+
+    f64 noise = spread_fraction * MAX(entry_spread_percent(base), entry_spread_percent(curr));
+    f64 threshold = MAX(threshold_floor, noise);
+
+    const char *result = "ok";
+    if (change > threshold)
+    {
+      result = "REGRESSION";
+      regressions += 1;
+    }
+    else if (change < -threshold)
+    {
+      result = "faster";
+      improvements += 1;
+    }
+
+    printf("%-6.*s %-40.*s %14lu %14lu %+8.2f%% %9.2f%%  %s\n", String_Format(base->kind), String_Format(base->name),
+           base->best, curr->best, change, threshold, result);
+  }
+
+  for (usize i = 0; i < current_count; i++)
+  {
+    Compare_Entry *curr = current + i;
+    if (!find_entry(baseline, baseline_count, curr->kind, curr->name))
+    {
+      printf("%-6.*s %-40.*s %14s %14lu %9s %10s  new\n", String_Format(curr->kind), String_Format(curr->name), "-", curr->best, "-", "-");
+    }
+  }
+
+  printf("%lu regressions, %lu faster\n", regressions, improvements);
+
+  arena_free(&arena);
+
+  return regressions ? 1 : 0;
+}
@@ -672,3 +672,21 @@ C_Tokenize_Result tokenize_c_code(Arena *arena, String code)
 
   return result;
 }
+
+static
+C_Tokenize_Result tokenize_c_file(Arena *arena, String name)
+{
+  C_Tokenize_Result result = {0};
+
+  String code = map_file_readonly(name, FILE_MAP_SEQUENTIAL);
+  if (code.v)
+  {
+    result = tokenize_c_code(arena, code);
+  }
+  else
+  {
+    result.had_error = true;
+  }
+
+  return result;
+}
@@ -164,4 +164,9 @@ struct C_Tokenize_Result
 static
 C_Tokenize_Result tokenize_c_code(Arena *arena, String code);
 
+// Maps the file rather than copying it, tokens point straight into the mapping
+// so unmap_file(result.source) once done with them
+static
+C_Tokenize_Result tokenize_c_file(Arena *arena, String name);
+
 #endif // C_TOKENIZE
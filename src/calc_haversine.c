@@ -4,11 +4,14 @@
 #include "benchmark/profile.h"
 
 #include "benchmark/platform_timing.c"
+#include "benchmark/latency_histogram.c"
+#include "benchmark/benchmark_results.c"
 #include "benchmark/profile.c"
 #include "json_parse.c"
 #include "haversine_impl.c"
 
-#define DESIRED_ARG_COUNT 2 + 1
+#define DESIRED_POSITIONAL_COUNT 2
+#define BINARY_POSITIONAL_COUNT  1 // Answer is in the file's header
 
 static
 b32 epsilon_equal(f64 a, f64 b)
@@ -18,14 +21,88 @@ b32 epsilon_equal(f64 a, f64 b)
   return (fabs(a) - fabs(b)) <= epsilon;
 }
 
-int main(int args_count, char **args)
+typedef struct Haversine_Sum_Job Haversine_Sum_Job;
+struct Haversine_Sum_Job
 {
-  if (args_count != DESIRED_ARG_COUNT)
+  Haversine_Pair_Columns *columns;
+
+  // Range of blocks this job owns, writes one sum per block
+  usize first_block;
+  usize block_count;
+  f64   *block_sums;
+
+  b32 use_batch;
+};
+
+static
+void *haversine_sum_worker(void *params)
+{
+  Haversine_Sum_Job *job = (Haversine_Sum_Job *)params;
+
+  usize first_pair = MIN(job->first_block * HAVERSINE_SUM_BLOCK_PAIRS, job->columns->count);
+  usize close_pair = MIN((job->first_block + job->block_count) * HAVERSINE_SUM_BLOCK_PAIRS, job->columns->count);
+
+  PROFILE_SCOPE_BANDWIDTH("sum worker", (close_pair - first_pair) * sizeof(Haversine_Pair))
   {
-    printf("Usage: %s [haversine_json] [solution_dump]\n", args[0]);
-    return 1;
+    for (usize block_idx = job->first_block; block_idx < job->first_block + job->block_count; block_idx++)
+    {
+      usize first = block_idx * HAVERSINE_SUM_BLOCK_PAIRS;
+      usize close = MIN(first + HAVERSINE_SUM_BLOCK_PAIRS, job->columns->count);
+
+      job->block_sums[block_idx] = haversine_block_sum_columns(job->columns, first, close, job->use_batch);
+    }
+  }
+
+  return NULL;
+}
+
+// Fills the columns straight from the json events, expects {"pairs": [{"x0":, "y0":, "x1":, "y1":}, ...]}
+typedef struct Haversine_Stream_Sink Haversine_Stream_Sink;
+struct Haversine_Stream_Sink
+{
+  Haversine_Pair_Columns *columns;
+
+  b32 in_pairs;
+  f64 pending[4]; // x0, y0, x1, y1
+};
+
+static
+void haversine_stream_event(JSON_Event *event, void *user_data)
+{
+  Haversine_Stream_Sink *sink = (Haversine_Stream_Sink *)user_data;
+
+  if (event->depth == 1 && event->type == JSON_EVENT_BEGIN_ARRAY && string_match(event->key, String("pairs")))
+  {
+    sink->in_pairs = true;
+  }
+  else if (sink->in_pairs)
+  {
+    // Close events carry no key, but the only array closing at this depth is the pairs one
+    if (event->depth == 1 && event->type == JSON_EVENT_CLOSE_ARRAY)
+    {
+      sink->in_pairs = false;
+    }
+    else if (event->depth == 3 && event->type == JSON_EVENT_VALUE && event->key.count == 2)
+    {
+      // Keys are always [xy][01]
+      u8 axis  = event->key.v[0];
+      u8 point = event->key.v[1];
+      if ((axis == 'x' || axis == 'y') && (point == '0' || point == '1'))
+      {
+        usize index = (point - '0') * 2 + (axis == 'y');
+        sink->pending[index] = string_to_f64(event->value.value);
+      }
+    }
+    else if (event->depth == 2 && event->type == JSON_EVENT_CLOSE_OBJECT)
+    {
+      haversine_columns_push(sink->columns, sink->pending[0], sink->pending[1], sink->pending[2], sink->pending[3]);
+      ZERO_STRUCT(&sink->pending);
+    }
   }
+}
 
+int main(int args_count, char **args)
+{
   begin_profiling();
 
   Arena arena;
@@ -34,58 +111,272 @@ int main(int args_count, char **args)
     arena = arena_make(.reserve_size = GB(64));
   }
 
+  Args arguments = parse_args(&arena, args_count, args);
+
+  // Input is haversine_pairs.bin, mapped and used as is with no parsing at all
+  b32 use_binary = args_has_flag(&arguments, String("binary"));
+
+  if (arguments.positionals_count != DESIRED_POSITIONAL_COUNT &&
+      !(use_binary && arguments.positionals_count == BINARY_POSITIONAL_COUNT))
+  {
+    printf("Usage: %s [haversine_json] [solution_dump] [--threads=N] [--batch] [--stream] [--mmap] [--pipeline] [--chunk-kb=N] [--tape] [--trace=path] [--counters] [--sample] [--sample-hz=N] [--results=csv]\n"
+           "       %s [haversine_bin] --binary [--threads=N] [--batch]\n", args[0], args[0]);
+    return 1;
+  }
+
+  // Record every pass and dump a timeline that chrome://tracing or ui.perfetto.dev can open
+  String trace_name = args_get_string_value(&arguments, String("trace"), (String){0});
+  if (trace_name.count)
+  {
+    profile_record_events(PROFILE_DEFAULT_EVENT_CAPACITY);
+  }
+
+  // Hardware counter deltas per zone, if the machine has them
+  if (args_has_flag(&arguments, String("counters")))
+  {
+    profile_enable_counters();
+  }
+
+  // Timer samples per zone next to the instrumented numbers
+  if (args_has_flag(&arguments, String("sample")))
+  {
+    profile_enable_sampling(args_get_integer_value(&arguments, String("sample-hz"), PROFILE_DEFAULT_SAMPLE_RATE));
+  }
+
+  String json_name     = arguments.positionals[0];
+  String solution_name = arguments.positionals[1];
+
+  usize thread_count = args_get_integer_value(&arguments, String("threads"), 1);
+  thread_count = CLAMP(thread_count, 1, 256);
+
+  // Use the polynomial batch kernel instead of libm, within HAVERSINE_BATCH_MAX_ERROR of reference
+  b32 use_batch = args_has_flag(&arguments, String("batch"));
+  if (use_batch)
+  {
+    LOG_INFO("Using %s haversine batch kernel", haversine_batch_name(haversine_batch_select()));
+  }
+
+  // Never build the json tree, go straight from tokens to pair columns
+  b32 use_stream = args_has_flag(&arguments, String("stream")) && !use_binary;
+
+  // Read in chunks on a helper thread while streaming, never holds the whole file
+  b32 use_pipeline = args_has_flag(&arguments, String("pipeline")) && !use_binary;
+  usize chunk_size = KB(args_get_integer_value(&arguments, String("chunk-kb"), 1024));
+  if (use_pipeline)
+  {
+    use_stream = true;
+  }
+
+  // Parse into the flat tape instead of the pointer tree, ignored when streaming
+  b32 use_tape = args_has_flag(&arguments, String("tape")) && !use_stream;
+
+  // View the file's pages directly instead of copying into the arena
+  b32 use_mmap = (args_has_flag(&arguments, String("mmap")) || use_binary) && !use_pipeline;
+
   String source = {0};
-  PROFILE_SCOPE_BANDWIDTH("read", file_size(args[1]))
+  usize source_size = file_size(string_to_c_string(&arena, json_name));
+  if (use_pipeline)
   {
-    source = read_file_to_arena(&arena, string_from_c_string(args[1]));
+    // Nothing up front, the reader thread does it
+  }
+  else if (use_mmap)
+  {
+    PROFILE_SCOPE_BANDWIDTH("map", file_size(string_to_c_string(&arena, json_name)))
+    {
+      source = map_file_readonly(json_name, FILE_MAP_SEQUENTIAL);
+    }
+  }
+  else
+  {
+    PROFILE_SCOPE_BANDWIDTH("read", file_size(string_to_c_string(&arena, json_name)))
+    {
+      source = read_file_to_arena(&arena, json_name);
+    }
   }
 
-  usize min_pair_bytes = 6 * 4; // 6 chars for something like "x0:0" (at least) and 4 of those
-  usize max_pairs = source.count / min_pair_bytes; // Roughly, overestimate at least
-  Haversine_Pair *pairs = arena_calloc(&arena, max_pairs, Haversine_Pair);
-  usize pair_count = 0;
+  Haversine_Pair_Columns columns = {0};
+  usize parse_memory = 0;
+  Haversine_Pairs_Header binary_header = {0};
+  if (use_binary)
+  {
+    // Only real work is the checksums, columns point right into the mapping
+    PROFILE_SCOPE_BANDWIDTH("load binary", source.count)
+    {
+      if (!haversine_pairs_load(source, &binary_header, &columns))
+      {
+        LOG_ERROR("Failed to load binary haversine pairs");
+      }
+    }
+  }
+  else if (use_pipeline)
+  {
+    PROFILE_SCOPE_BANDWIDTH("parse pipeline", source_size)
+    {
+      usize min_pair_bytes = 6 * 4;
+      columns = haversine_columns_reserve(source_size / min_pair_bytes);
 
-  JSON_Object *root = parse_json(&arena, source);
+      Haversine_Stream_Sink sink = {.columns = &columns};
+      if (!stream_json_file(json_name, chunk_size, haversine_stream_event, &sink, NULL))
+      {
+        LOG_ERROR("Failed to stream haversine json");
+      }
+    }
 
-  JSON_Object *pairs_object = lookup_json_object(root, String("pairs"));
-  if (pairs)
+    for (usize i = 0; i < STATIC_COUNT(columns.column_arenas); i++)
+    {
+      parse_memory += columns.column_arenas[i].commit_size;
+    }
+    parse_memory += JSON_READER_BUFFER_COUNT * (JSON_READER_LOOKAHEAD + chunk_size);
+  }
+  else if (use_stream)
   {
-    for (JSON_Object *cursor = pairs_object->first_child; cursor && pair_count < max_pairs; cursor = cursor->next_sibling)
+    PROFILE_SCOPE_BANDWIDTH("parse stream", source.count)
     {
-      Haversine_Pair pair =
+      // Only a reservation, pages get committed as pairs actually show up
+      usize min_pair_bytes = 6 * 4; // 6 chars for something like "x0:0" (at least) and 4 of those
+      columns = haversine_columns_reserve(source.count / min_pair_bytes);
+
+      Haversine_Stream_Sink sink = {.columns = &columns};
+      if (!stream_json(source, haversine_stream_event, &sink))
       {
-        .x0 = json_object_to_f64(lookup_json_object(cursor, String("x0"))),
-        .y0 = json_object_to_f64(lookup_json_object(cursor, String("y0"))),
-        .x1 = json_object_to_f64(lookup_json_object(cursor, String("x1"))),
-        .y1 = json_object_to_f64(lookup_json_object(cursor, String("y1"))),
-      };
+        LOG_ERROR("Failed to stream haversine json");
+      }
+    }
 
-      pairs[pair_count] = pair;
-      pair_count += 1;
+    for (usize i = 0; i < STATIC_COUNT(columns.column_arenas); i++)
+    {
+      parse_memory += columns.column_arenas[i].commit_size;
+    }
+  }
+  else if (use_tape)
+  {
+    usize arena_before = arena.next_offset;
+    PROFILE_SCOPE_BANDWIDTH("parse tape", source.count)
+    {
+      JSON_Tape tape = parse_json_tape(&arena, source);
+
+      JSON_Cursor pairs_cursor = lookup_json_cursor(json_tape_root(&tape), String("pairs"));
+
+      columns = haversine_columns_alloc(&arena, json_cursor_child_count(pairs_cursor));
+      for (JSON_Cursor cursor = json_cursor_first_child(pairs_cursor); json_cursor_valid(cursor); cursor = json_cursor_next_sibling(cursor))
+      {
+        usize at = columns.count;
+        columns.x0[at] = json_cursor_to_f64(lookup_json_cursor(cursor, String("x0")));
+        columns.y0[at] = json_cursor_to_f64(lookup_json_cursor(cursor, String("y0")));
+        columns.x1[at] = json_cursor_to_f64(lookup_json_cursor(cursor, String("x1")));
+        columns.y1[at] = json_cursor_to_f64(lookup_json_cursor(cursor, String("y1")));
+        columns.count += 1;
+      }
+    }
+    parse_memory = arena.next_offset - arena_before;
+  }
+  else
+  {
+    usize arena_before = arena.next_offset;
+    PROFILE_SCOPE_BANDWIDTH("parse tree", source.count)
+    {
+      JSON_Object *root = parse_json(&arena, source, JSON_PARSE_NONE);
+
+      JSON_Object *pairs_object = lookup_json_object(root, String("pairs"));
+
+      // Tree is already built so we can just count how many pairs exactly
+      usize max_pairs = 0;
+      for (JSON_Object *cursor = pairs_object ? pairs_object->first_child : NULL; cursor; cursor = cursor->next_sibling)
+      {
+        max_pairs += 1;
+      }
+
+      columns = haversine_columns_alloc(&arena, max_pairs);
+      if (pairs_object)
+      {
+        for (JSON_Object *cursor = pairs_object->first_child; cursor; cursor = cursor->next_sibling)
+        {
+          usize at = columns.count;
+          columns.x0[at] = json_object_to_f64(lookup_json_object(cursor, String("x0")));
+          columns.y0[at] = json_object_to_f64(lookup_json_object(cursor, String("y0")));
+          columns.x1[at] = json_object_to_f64(lookup_json_object(cursor, String("x1")));
+          columns.y1[at] = json_object_to_f64(lookup_json_object(cursor, String("y1")));
+          columns.count += 1;
+        }
+      }
     }
+    parse_memory = arena.next_offset - arena_before;
   }
 
+  usize pair_count = columns.count;
+
+  usize block_count = haversine_sum_block_count(pair_count);
+  f64   *block_sums = arena_calloc(&arena, block_count, f64);
+
+  Haversine_Sum_Job jobs[256] = {0};
+  thread_count = MIN(thread_count, MAX(block_count, 1));
+
   f64 sum = 0.0;
   PROFILE_SCOPE_BANDWIDTH("sum", pair_count * sizeof(Haversine_Pair))
   {
-    for (usize i = 0; i < pair_count; i++)
+    OS_Thread threads[STATIC_COUNT(jobs)] = {0};
+
+    // Hand out whole blocks, earlier threads pick up the remainder
+    usize blocks_per_thread = block_count / thread_count;
+    usize blocks_remainder  = block_count % thread_count;
+    usize next_block = 0;
+    for (usize thread_idx = 0; thread_idx < thread_count; thread_idx++)
+    {
+      Haversine_Sum_Job *job = jobs + thread_idx;
+      job->columns     = &columns;
+      job->first_block = next_block;
+      job->block_count = blocks_per_thread + (thread_idx < blocks_remainder ? 1 : 0);
+      job->block_sums  = block_sums;
+      job->use_batch   = use_batch;
+
+      next_block += job->block_count;
+
+      // Main thread does the first job itself
+      if (thread_idx > 0)
+      {
+        threads[thread_idx] = os_thread_launch(haversine_sum_worker, job);
+      }
+    }
+
+    haversine_sum_worker(jobs + 0);
+
+    for (usize thread_idx = 1; thread_idx < thread_count; thread_idx++)
+    {
+      os_thread_join(threads[thread_idx]);
+    }
+
+    sum = pairwise_sum_f64(block_sums, block_count);
+    if (pair_count)
     {
-      f64 earth_radius = 6372.8;
-      f64 result = reference_haversine(pairs[i].x0,pairs[i].y0,pairs[i].x1,pairs[i].y1, earth_radius);
-      sum += result;
+      sum /= pair_count;
     }
-    sum /= pair_count;
   }
 
   PROFILE_SCOPE("check")
   {
-    // Get solutions out of binary dump and verify
-    String solution_dump = read_file_to_arena(&arena, string_from_c_string(args[2]));
-    if (solution_dump.count >= sizeof(f64) + sizeof(i32))
+    // Get solutions out of binary dump (or the binary file's header) and verify
+    f64   solution_sum   = 0.0;
+    usize solution_pairs = 0;
+    b32   have_solution  = false;
+    if (use_binary)
     {
-      f64 solution_sum = *(f64 *)solution_dump.v;
-      usize solution_pairs = *(usize *)(solution_dump.v + sizeof(f64));
+      solution_sum   = binary_header.expected_average;
+      solution_pairs = binary_header.pair_count;
+      have_solution  = binary_header.version == HAVERSINE_PAIRS_VERSION;
+    }
+    else
+    {
+      String solution_dump = read_file_to_arena(&arena, solution_name);
+      if (solution_dump.count >= sizeof(f64) + sizeof(usize))
+      {
+        MEM_COPY(&solution_sum, solution_dump.v, sizeof(f64));
+        MEM_COPY(&solution_pairs, solution_dump.v + sizeof(f64), sizeof(usize));
+        have_solution = true;
+      }
+    }
 
+    if (have_solution)
+    {
       if (solution_pairs == pair_count)
       {
         if (epsilon_equal(solution_sum, sum))
@@ -110,5 +401,27 @@ int main(int args_count, char **args)
 
   end_profiling();
 
+  if (trace_name.count)
+  {
+    profile_write_chrome_trace(trace_name);
+  }
+
+  // For benchmark_compare, appends so repeated runs add up into a spread
+  String results_name = args_get_string_value(&arguments, String("results"), (String){0});
+  if (results_name.count)
+  {
+    profile_write_results(results_name);
+  }
+
+  printf("[PROFILE] Parse memory (%s): %lu bytes (%.4fx of %lu byte input)\n",
+         use_binary ? "binary" : use_pipeline ? "pipeline" : use_stream ? "stream" : use_tape ? "tape" : "tree",
+         parse_memory, source_size ? (f64)parse_memory / (f64)source_size : 0.0, source_size);
+
+  if (use_mmap)
+  {
+    unmap_file(source);
+  }
+
+  haversine_columns_free(&columns);
   arena_free(&arena);
 }
@@ -23,6 +23,25 @@ struct Haversine_Pair
   f64 y1;
 };
 
+// Structure of arrays version, what the batch kernel wants to chew on
+typedef struct Haversine_Pair_Columns Haversine_Pair_Columns;
+struct Haversine_Pair_Columns
+{
+  f64 *x0;
+  f64 *y0;
+  f64 *x1;
+  f64 *y1;
+
+  usize count;
+  usize capacity;
+
+  // Only used when growing, each column gets its own reserved range so they stay contiguous
+  Arena column_arenas[4];
+};
+
+#define HAVERSINE_COLUMN_ALIGNMENT   64
+#define HAVERSINE_COLUMN_GROW_COUNT  (KB(4) / sizeof(f64)) // A page of each column at a time
+
 static
 f64 reference_haversine(f64 x0, f64 y0, f64 x1, f64 y1, f64 sphere_radius)
 {
@@ -43,3 +62,701 @@ f64 reference_haversine(f64 x0, f64 y0, f64 x1, f64 y1, f64 sphere_radius)
 
   return result;
 }
+
+// Pairs get summed sequentially in fixed size blocks and then those block sums get reduced pairwise.
+// The final sum only depends on the order of the pairs, never on how many threads chewed through the
+// blocks, so it is bit for bit the same no matter the thread count
+#define HAVERSINE_SUM_BLOCK_PAIRS 4096
+
+static
+usize haversine_sum_block_count(usize pair_count)
+{
+  return (pair_count + HAVERSINE_SUM_BLOCK_PAIRS - 1) / HAVERSINE_SUM_BLOCK_PAIRS;
+}
+
+// When we know exactly how many pairs there are, all from the one arena
+static
+Haversine_Pair_Columns haversine_columns_alloc(Arena *arena, usize count)
+{
+  Haversine_Pair_Columns columns =
+  {
+    .x0 = (f64 *)arena_alloc(arena, count * sizeof(f64), HAVERSINE_COLUMN_ALIGNMENT),
+    .y0 = (f64 *)arena_alloc(arena, count * sizeof(f64), HAVERSINE_COLUMN_ALIGNMENT),
+    .x1 = (f64 *)arena_alloc(arena, count * sizeof(f64), HAVERSINE_COLUMN_ALIGNMENT),
+    .y1 = (f64 *)arena_alloc(arena, count * sizeof(f64), HAVERSINE_COLUMN_ALIGNMENT),
+    .count    = 0,
+    .capacity = count,
+  };
+
+  return columns;
+}
+
+// When we don't, only reserves up to max_count, and commits a page per column at a time as pushed
+static
+Haversine_Pair_Columns haversine_columns_reserve(usize max_count)
+{
+  Haversine_Pair_Columns columns = {0};
+
+  usize reserve_size = ALIGN_POW2_UP(max_count * sizeof(f64), KB(4)) + KB(4);
+  for (usize i = 0; i < STATIC_COUNT(columns.column_arenas); i++)
+  {
+    columns.column_arenas[i] = arena_make(.reserve_size = reserve_size, .commit_size = KB(4));
+  }
+
+  return columns;
+}
+
+static
+void haversine_columns_free(Haversine_Pair_Columns *columns)
+{
+  for (usize i = 0; i < STATIC_COUNT(columns->column_arenas); i++)
+  {
+    if (columns->column_arenas[i].base)
+    {
+      arena_free(&columns->column_arenas[i]);
+    }
+  }
+
+  ZERO_STRUCT(columns);
+}
+
+static
+void haversine_columns_push(Haversine_Pair_Columns *columns, f64 x0, f64 y0, f64 x1, f64 y1)
+{
+  if (columns->count == columns->capacity)
+  {
+    ASSERT(columns->column_arenas[0].base, "Tried to grow haversine columns that weren't reserved");
+
+    f64 *grown[4] = {0};
+    for (usize i = 0; i < STATIC_COUNT(grown); i++)
+    {
+      grown[i] = (f64 *)arena_alloc(&columns->column_arenas[i], HAVERSINE_COLUMN_GROW_COUNT * sizeof(f64), HAVERSINE_COLUMN_ALIGNMENT);
+    }
+
+    // Only the first grow actually sets the pointers, after that it just extends them
+    if (!columns->capacity)
+    {
+      columns->x0 = grown[0];
+      columns->y0 = grown[1];
+      columns->x1 = grown[2];
+      columns->y1 = grown[3];
+    }
+
+    columns->capacity += HAVERSINE_COLUMN_GROW_COUNT;
+  }
+
+  usize at = columns->count;
+  columns->x0[at] = x0;
+  columns->y0[at] = y0;
+  columns->x1[at] = x1;
+  columns->y1[at] = y1;
+  columns->count += 1;
+}
+
+static
+f64 pairwise_sum_f64(f64 *values, usize count)
+{
+  f64 result = 0.0;
+
+  if (count <= 8)
+  {
+    for (usize i = 0; i < count; i++)
+    {
+      result += values[i];
+    }
+  }
+  else
+  {
+    usize half = count / 2;
+    result = pairwise_sum_f64(values, half) + pairwise_sum_f64(values + half, count - half);
+  }
+
+  return result;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// BINARY PAIRS FILE
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// [header][pad][x0 column][pad][y0 column][pad][x1 column][pad][y1 column]
+// Columns are plain f64 arrays, HAVERSINE_COLUMN_ALIGNMENT aligned from the start of the file, so a
+// mapping of the file can be used as Haversine_Pair_Columns as is. Little endian only, same as us
+#define HAVERSINE_PAIRS_MAGIC   "HAVPAIRS"
+#define HAVERSINE_PAIRS_VERSION 1
+
+// FNV-1a, just over whole f64s rather than bytes
+#define HAVERSINE_CHECKSUM_SEED  0xCBF29CE484222325ull
+#define HAVERSINE_CHECKSUM_PRIME 0x00000100000001B3ull
+
+typedef struct Haversine_Pairs_Header Haversine_Pairs_Header;
+struct Haversine_Pairs_Header
+{
+  u8  magic[8];
+  u32 version;
+  u32 header_size;
+  u64 file_size;
+
+  u64 pair_count;
+  u64 column_offsets[4];   // x0, y0, x1, y1
+  u64 column_checksums[4];
+
+  f64 expected_average;    // Reference haversine average, same thing solution_dump.data holds for json
+};
+
+static
+Haversine_Pairs_Header haversine_pairs_header_make(usize pair_count)
+{
+  Haversine_Pairs_Header header =
+  {
+    .version     = HAVERSINE_PAIRS_VERSION,
+    .header_size = sizeof(Haversine_Pairs_Header),
+    .pair_count  = pair_count,
+  };
+  MEM_COPY(header.magic, HAVERSINE_PAIRS_MAGIC, sizeof(header.magic));
+
+  usize at = sizeof(Haversine_Pairs_Header);
+  for (usize i = 0; i < STATIC_COUNT(header.column_offsets); i++)
+  {
+    at = ALIGN_POW2_UP(at, HAVERSINE_COLUMN_ALIGNMENT);
+    header.column_offsets[i]   = at;
+    header.column_checksums[i] = HAVERSINE_CHECKSUM_SEED;
+    at += pair_count * sizeof(f64);
+  }
+  header.file_size = at;
+
+  return header;
+}
+
+// Can be fed a column in pieces, start with HAVERSINE_CHECKSUM_SEED
+static
+u64 haversine_checksum_f64(u64 checksum, const f64 *values, usize count)
+{
+  for (usize i = 0; i < count; i++)
+  {
+    u64 bits = 0;
+    MEM_COPY(&bits, values + i, sizeof(bits));
+
+    checksum ^= bits;
+    checksum *= HAVERSINE_CHECKSUM_PRIME;
+  }
+
+  return checksum;
+}
+
+// No copies, the columns point straight into file (likely a map_file_readonly()), so keep that around as
+// long as the columns. Returns false and leaves the columns empty if anything about the file is off
+static
+b32 haversine_pairs_load(String file, Haversine_Pairs_Header *header, Haversine_Pair_Columns *columns)
+{
+  ZERO_STRUCT(header);
+  ZERO_STRUCT(columns);
+
+  if (file.count < sizeof(Haversine_Pairs_Header))
+  {
+    LOG_ERROR("Binary pairs file too small to hold a header (%lu bytes)", file.count);
+    return false;
+  }
+
+  MEM_COPY(header, file.v, sizeof(Haversine_Pairs_Header));
+
+  if (!MEM_MATCH(header->magic, HAVERSINE_PAIRS_MAGIC, sizeof(header->magic)))
+  {
+    LOG_ERROR("Not a binary pairs file, bad magic");
+    return false;
+  }
+
+  if (header->version != HAVERSINE_PAIRS_VERSION || header->header_size != sizeof(Haversine_Pairs_Header))
+  {
+    LOG_ERROR("Binary pairs file version %u (header %u bytes), only know version %u (header %lu bytes)",
+              header->version, header->header_size, HAVERSINE_PAIRS_VERSION, sizeof(Haversine_Pairs_Header));
+    return false;
+  }
+
+  if (header->file_size > file.count)
+  {
+    LOG_ERROR("Binary pairs file truncated, header says %lu bytes but only have %lu", header->file_size, file.count);
+    return false;
+  }
+
+  f64 *column_starts[4] = {0};
+  for (usize i = 0; i < STATIC_COUNT(column_starts); i++)
+  {
+    u64 offset = header->column_offsets[i];
+    if (offset % HAVERSINE_COLUMN_ALIGNMENT != 0 || offset < header->header_size ||
+        header->pair_count > (header->file_size - MIN(offset, header->file_size)) / sizeof(f64))
+    {
+      LOG_ERROR("Binary pairs file column %lu at offset %lu is misaligned or out of bounds", i, offset);
+      return false;
+    }
+
+    column_starts[i] = (f64 *)(file.v + offset);
+
+    u64 checksum = haversine_checksum_f64(HAVERSINE_CHECKSUM_SEED, column_starts[i], header->pair_count);
+    if (checksum != header->column_checksums[i])
+    {
+      LOG_ERROR("Binary pairs file column %lu checksum mismatch (0x%lx, expected 0x%lx)", i, checksum, header->column_checksums[i]);
+      return false;
+    }
+  }
+
+  columns->x0       = column_starts[0];
+  columns->y0       = column_starts[1];
+  columns->x1       = column_starts[2];
+  columns->y1       = column_starts[3];
+  columns->count    = header->pair_count;
+  columns->capacity = header->pair_count;
+
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// BATCH KERNEL
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Same math as reference_haversine (including the degrees / PI 'radians'), but with our own
+// polynomial sin/cos/asin so it can be done across 4 (AVX2) or 8 (AVX-512) pairs at once.
+//
+//   sin:  k = round(x / pi), r = x - k * pi in [-pi/2, pi/2], sin(x) = (-1)^k * sin(r),
+//         sin(r) as odd Taylor series up to r^19 (truncation < 3e-16 at pi/2)
+//   cos:  cos(x) = sin(x + pi/2)
+//   asin: fdlibm's rational approximation on [0, 0.5],
+//         asin(x) = pi/2 - 2 * asin(sqrt((1 - x) / 2)) above that
+//
+// Measured against reference_haversine over the uniform generator's input range the max absolute
+// error is 1e-8 to 5e-8 kilometers depending on the random pairs (mostly asin's slope blowing up
+// near 1), documented max is a bit looser than that and reptest_haversine checks it every run
+#define HAVERSINE_EARTH_RADIUS    6372.8
+#define HAVERSINE_BATCH_MAX_ERROR 1e-7
+
+#define HAVERSINE_PI_HI 3.14159265358979311600e+00
+#define HAVERSINE_PI_LO 1.22464679914735317720e-16
+
+static const f64 haversine_sin_coefficients[] =
+{
+   1.0,
+  -1.0 / 6.0,
+   1.0 / 120.0,
+  -1.0 / 5040.0,
+   1.0 / 362880.0,
+  -1.0 / 39916800.0,
+   1.0 / 6227020800.0,
+  -1.0 / 1307674368000.0,
+   1.0 / 355687428096000.0,
+  -1.0 / 121645100408832000.0,
+};
+
+// fdlibm e_asin.c
+#define HAVERSINE_ASIN_P0  1.66666666666666657415e-01
+#define HAVERSINE_ASIN_P1 -3.25565818622400915405e-01
+#define HAVERSINE_ASIN_P2  2.01212532134862925881e-01
+#define HAVERSINE_ASIN_P3 -4.00555345006794114027e-02
+#define HAVERSINE_ASIN_P4  7.91534994289814532176e-04
+#define HAVERSINE_ASIN_P5  3.47933107596021167570e-05
+#define HAVERSINE_ASIN_Q1 -2.40339491173441421878e+00
+#define HAVERSINE_ASIN_Q2  2.02094576023350569471e+00
+#define HAVERSINE_ASIN_Q3 -6.88283971605453293030e-01
+#define HAVERSINE_ASIN_Q4  7.70381505559019352791e-02
+
+typedef void Haversine_Batch_Function(const f64 *x0, const f64 *y0, const f64 *x1, const f64 *y1,
+                                      usize count, f64 *out);
+
+// Scalar ---
+
+static
+f64 approx_sin(f64 x)
+{
+  f64 k = nearbyint(x * (1.0 / PI));
+  f64 r = (x - k * HAVERSINE_PI_HI) - k * HAVERSINE_PI_LO;
+  f64 r2 = r * r;
+
+  usize last = STATIC_COUNT(haversine_sin_coefficients) - 1;
+  f64 poly = haversine_sin_coefficients[last];
+  for (usize i = last; i > 0; i--)
+  {
+    poly = poly * r2 + haversine_sin_coefficients[i - 1];
+  }
+
+  // (-1)^k without going through integers, k is always a small whole number
+  f64 sign = 1.0 - 2.0 * (k - 2.0 * floor(0.5 * k));
+
+  return sign * r * poly;
+}
+
+static
+f64 approx_cos(f64 x)
+{
+  return approx_sin(x + 0.5 * PI);
+}
+
+static
+f64 approx_asin_ratio(f64 t)
+{
+  f64 p = t * (HAVERSINE_ASIN_P0 + t * (HAVERSINE_ASIN_P1 + t * (HAVERSINE_ASIN_P2 +
+          t * (HAVERSINE_ASIN_P3 + t * (HAVERSINE_ASIN_P4 + t * HAVERSINE_ASIN_P5)))));
+  f64 q = 1.0 + t * (HAVERSINE_ASIN_Q1 + t * (HAVERSINE_ASIN_Q2 + t * (HAVERSINE_ASIN_Q3 + t * HAVERSINE_ASIN_Q4)));
+
+  return p / q;
+}
+
+// Only valid for x in [0, 1], which is all haversine ever asks for
+static
+f64 approx_asin(f64 x)
+{
+  f64 result = 0.0;
+
+  if (x <= 0.5)
+  {
+    result = x + x * approx_asin_ratio(x * x);
+  }
+  else
+  {
+    f64 t = (1.0 - x) * 0.5;
+    f64 s = sqrt(t);
+    result = 0.5 * PI - 2.0 * (s + s * approx_asin_ratio(t));
+  }
+
+  return result;
+}
+
+static
+void haversine_batch_scalar(const f64 *x0, const f64 *y0, const f64 *x1, const f64 *y1, usize count, f64 *out)
+{
+  for (usize i = 0; i < count; i++)
+  {
+    f64 d_lat = (y1[i] - y0[i]) * (1.0 / PI);
+    f64 d_lon = (x1[i] - x0[i]) * (1.0 / PI);
+    f64 lat1  = y0[i] * (1.0 / PI);
+    f64 lat2  = y1[i] * (1.0 / PI);
+
+    f64 a = square(approx_sin(0.5 * d_lat)) + approx_cos(lat1) * approx_cos(lat2) * square(approx_sin(0.5 * d_lon));
+    a = MIN(a, 1.0); // Approximations could nudge it just over
+
+    out[i] = HAVERSINE_EARTH_RADIUS * 2.0 * approx_asin(sqrt(a));
+  }
+}
+
+// AVX2 ---
+
+#include <immintrin.h>
+
+#define HAVERSINE_TARGET_AVX2   __attribute__((target("avx2,fma")))
+#define HAVERSINE_TARGET_AVX512 __attribute__((target("avx512f")))
+
+static HAVERSINE_TARGET_AVX2
+__m256d approx_sin_avx2(__m256d x)
+{
+  __m256d k = _mm256_round_pd(_mm256_mul_pd(x, _mm256_set1_pd(1.0 / PI)), _MM_FROUND_TO_NEAREST_INT|_MM_FROUND_NO_EXC);
+  __m256d r = _mm256_fnmadd_pd(k, _mm256_set1_pd(HAVERSINE_PI_HI), x);
+  r = _mm256_fnmadd_pd(k, _mm256_set1_pd(HAVERSINE_PI_LO), r);
+  __m256d r2 = _mm256_mul_pd(r, r);
+
+  usize last = STATIC_COUNT(haversine_sin_coefficients) - 1;
+  __m256d poly = _mm256_set1_pd(haversine_sin_coefficients[last]);
+  for (usize i = last; i > 0; i--)
+  {
+    poly = _mm256_fmadd_pd(poly, r2, _mm256_set1_pd(haversine_sin_coefficients[i - 1]));
+  }
+
+  __m256d half_k = _mm256_floor_pd(_mm256_mul_pd(k, _mm256_set1_pd(0.5)));
+  __m256d parity = _mm256_fnmadd_pd(half_k, _mm256_set1_pd(2.0), k);
+  __m256d sign   = _mm256_fnmadd_pd(parity, _mm256_set1_pd(2.0), _mm256_set1_pd(1.0));
+
+  return _mm256_mul_pd(sign, _mm256_mul_pd(r, poly));
+}
+
+static HAVERSINE_TARGET_AVX2
+__m256d approx_asin_ratio_avx2(__m256d t)
+{
+  __m256d p = _mm256_set1_pd(HAVERSINE_ASIN_P5);
+  p = _mm256_fmadd_pd(p, t, _mm256_set1_pd(HAVERSINE_ASIN_P4));
+  p = _mm256_fmadd_pd(p, t, _mm256_set1_pd(HAVERSINE_ASIN_P3));
+  p = _mm256_fmadd_pd(p, t, _mm256_set1_pd(HAVERSINE_ASIN_P2));
+  p = _mm256_fmadd_pd(p, t, _mm256_set1_pd(HAVERSINE_ASIN_P1));
+  p = _mm256_fmadd_pd(p, t, _mm256_set1_pd(HAVERSINE_ASIN_P0));
+  p = _mm256_mul_pd(p, t);
+
+  __m256d q = _mm256_set1_pd(HAVERSINE_ASIN_Q4);
+  q = _mm256_fmadd_pd(q, t, _mm256_set1_pd(HAVERSINE_ASIN_Q3));
+  q = _mm256_fmadd_pd(q, t, _mm256_set1_pd(HAVERSINE_ASIN_Q2));
+  q = _mm256_fmadd_pd(q, t, _mm256_set1_pd(HAVERSINE_ASIN_Q1));
+  q = _mm256_fmadd_pd(q, t, _mm256_set1_pd(1.0));
+
+  return _mm256_div_pd(p, q);
+}
+
+static HAVERSINE_TARGET_AVX2
+__m256d approx_asin_avx2(__m256d x)
+{
+  // Both sides and then blend, no branching per lane
+  __m256d small = _mm256_fmadd_pd(x, approx_asin_ratio_avx2(_mm256_mul_pd(x, x)), x);
+
+  __m256d t = _mm256_mul_pd(_mm256_sub_pd(_mm256_set1_pd(1.0), x), _mm256_set1_pd(0.5));
+  __m256d s = _mm256_sqrt_pd(t);
+  __m256d big = _mm256_fmadd_pd(s, approx_asin_ratio_avx2(t), s);
+  big = _mm256_fnmadd_pd(big, _mm256_set1_pd(2.0), _mm256_set1_pd(0.5 * PI));
+
+  __m256d is_big = _mm256_cmp_pd(x, _mm256_set1_pd(0.5), _CMP_GT_OQ);
+
+  return _mm256_blendv_pd(small, big, is_big);
+}
+
+static HAVERSINE_TARGET_AVX2
+void haversine_batch_avx2(const f64 *x0, const f64 *y0, const f64 *x1, const f64 *y1, usize count, f64 *out)
+{
+  usize lanes = 4;
+  usize wide_count = count - (count % lanes);
+
+  __m256d inv_pi     = _mm256_set1_pd(1.0 / PI);
+  __m256d half       = _mm256_set1_pd(0.5);
+  __m256d half_pi    = _mm256_set1_pd(0.5 * PI);
+  __m256d one        = _mm256_set1_pd(1.0);
+  __m256d diameter   = _mm256_set1_pd(2.0 * HAVERSINE_EARTH_RADIUS);
+
+  for (usize i = 0; i < wide_count; i += lanes)
+  {
+    __m256d vx0 = _mm256_loadu_pd(x0 + i);
+    __m256d vy0 = _mm256_loadu_pd(y0 + i);
+    __m256d vx1 = _mm256_loadu_pd(x1 + i);
+    __m256d vy1 = _mm256_loadu_pd(y1 + i);
+
+    __m256d d_lat = _mm256_mul_pd(_mm256_sub_pd(vy1, vy0), inv_pi);
+    __m256d d_lon = _mm256_mul_pd(_mm256_sub_pd(vx1, vx0), inv_pi);
+    __m256d lat1  = _mm256_mul_pd(vy0, inv_pi);
+    __m256d lat2  = _mm256_mul_pd(vy1, inv_pi);
+
+    __m256d sin_lat = approx_sin_avx2(_mm256_mul_pd(d_lat, half));
+    __m256d sin_lon = approx_sin_avx2(_mm256_mul_pd(d_lon, half));
+    __m256d cos1    = approx_sin_avx2(_mm256_add_pd(lat1, half_pi));
+    __m256d cos2    = approx_sin_avx2(_mm256_add_pd(lat2, half_pi));
+
+    __m256d a = _mm256_mul_pd(_mm256_mul_pd(cos1, cos2), _mm256_mul_pd(sin_lon, sin_lon));
+    a = _mm256_fmadd_pd(sin_lat, sin_lat, a);
+    a = _mm256_min_pd(a, one);
+
+    __m256d c = approx_asin_avx2(_mm256_sqrt_pd(a));
+
+    _mm256_storeu_pd(out + i, _mm256_mul_pd(diameter, c));
+  }
+
+  haversine_batch_scalar(x0 + wide_count, y0 + wide_count, x1 + wide_count, y1 + wide_count,
+                         count - wide_count, out + wide_count);
+}
+
+// AVX-512 ---
+
+static HAVERSINE_TARGET_AVX512
+__m512d approx_sin_avx512(__m512d x)
+{
+  __m512d k = _mm512_roundscale_pd(_mm512_mul_pd(x, _mm512_set1_pd(1.0 / PI)), _MM_FROUND_TO_NEAREST_INT|_MM_FROUND_NO_EXC);
+  __m512d r = _mm512_fnmadd_pd(k, _mm512_set1_pd(HAVERSINE_PI_HI), x);
+  r = _mm512_fnmadd_pd(k, _mm512_set1_pd(HAVERSINE_PI_LO), r);
+  __m512d r2 = _mm512_mul_pd(r, r);
+
+  usize last = STATIC_COUNT(haversine_sin_coefficients) - 1;
+  __m512d poly = _mm512_set1_pd(haversine_sin_coefficients[last]);
+  for (usize i = last; i > 0; i--)
+  {
+    poly = _mm512_fmadd_pd(poly, r2, _mm512_set1_pd(haversine_sin_coefficients[i - 1]));
+  }
+
+  __m512d half_k = _mm512_roundscale_pd(_mm512_mul_pd(k, _mm512_set1_pd(0.5)), _MM_FROUND_TO_NEG_INF|_MM_FROUND_NO_EXC);
+  __m512d parity = _mm512_fnmadd_pd(half_k, _mm512_set1_pd(2.0), k);
+  __m512d sign   = _mm512_fnmadd_pd(parity, _mm512_set1_pd(2.0), _mm512_set1_pd(1.0));
+
+  return _mm512_mul_pd(sign, _mm512_mul_pd(r, poly));
+}
+
+static HAVERSINE_TARGET_AVX512
+__m512d approx_asin_ratio_avx512(__m512d t)
+{
+  __m512d p = _mm512_set1_pd(HAVERSINE_ASIN_P5);
+  p = _mm512_fmadd_pd(p, t, _mm512_set1_pd(HAVERSINE_ASIN_P4));
+  p = _mm512_fmadd_pd(p, t, _mm512_set1_pd(HAVERSINE_ASIN_P3));
+  p = _mm512_fmadd_pd(p, t, _mm512_set1_pd(HAVERSINE_ASIN_P2));
+  p = _mm512_fmadd_pd(p, t, _mm512_set1_pd(HAVERSINE_ASIN_P1));
+  p = _mm512_fmadd_pd(p, t, _mm512_set1_pd(HAVERSINE_ASIN_P0));
+  p = _mm512_mul_pd(p, t);
+
+  __m512d q = _mm512_set1_pd(HAVERSINE_ASIN_Q4);
+  q = _mm512_fmadd_pd(q, t, _mm512_set1_pd(HAVERSINE_ASIN_Q3));
+  q = _mm512_fmadd_pd(q, t, _mm512_set1_pd(HAVERSINE_ASIN_Q2));
+  q = _mm512_fmadd_pd(q, t, _mm512_set1_pd(HAVERSINE_ASIN_Q1));
+  q = _mm512_fmadd_pd(q, t, _mm512_set1_pd(1.0));
+
+  return _mm512_div_pd(p, q);
+}
+
+static HAVERSINE_TARGET_AVX512
+__m512d approx_asin_avx512(__m512d x)
+{
+  __m512d small = _mm512_fmadd_pd(x, approx_asin_ratio_avx512(_mm512_mul_pd(x, x)), x);
+
+  __m512d t = _mm512_mul_pd(_mm512_sub_pd(_mm512_set1_pd(1.0), x), _mm512_set1_pd(0.5));
+  __m512d s = _mm512_sqrt_pd(t);
+  __m512d big = _mm512_fmadd_pd(s, approx_asin_ratio_avx512(t), s);
+  big = _mm512_fnmadd_pd(big, _mm512_set1_pd(2.0), _mm512_set1_pd(0.5 * PI));
+
+  __mmask8 is_big = _mm512_cmp_pd_mask(x, _mm512_set1_pd(0.5), _CMP_GT_OQ);
+
+  return _mm512_mask_blend_pd(is_big, small, big);
+}
+
+static HAVERSINE_TARGET_AVX512
+void haversine_batch_avx512(const f64 *x0, const f64 *y0, const f64 *x1, const f64 *y1, usize count, f64 *out)
+{
+  usize lanes = 8;
+  usize wide_count = count - (count % lanes);
+
+  __m512d inv_pi     = _mm512_set1_pd(1.0 / PI);
+  __m512d half       = _mm512_set1_pd(0.5);
+  __m512d half_pi    = _mm512_set1_pd(0.5 * PI);
+  __m512d one        = _mm512_set1_pd(1.0);
+  __m512d diameter   = _mm512_set1_pd(2.0 * HAVERSINE_EARTH_RADIUS);
+
+  for (usize i = 0; i < wide_count; i += lanes)
+  {
+    __m512d vx0 = _mm512_loadu_pd(x0 + i);
+    __m512d vy0 = _mm512_loadu_pd(y0 + i);
+    __m512d vx1 = _mm512_loadu_pd(x1 + i);
+    __m512d vy1 = _mm512_loadu_pd(y1 + i);
+
+    __m512d d_lat = _mm512_mul_pd(_mm512_sub_pd(vy1, vy0), inv_pi);
+    __m512d d_lon = _mm512_mul_pd(_mm512_sub_pd(vx1, vx0), inv_pi);
+    __m512d lat1  = _mm512_mul_pd(vy0, inv_pi);
+    __m512d lat2  = _mm512_mul_pd(vy1, inv_pi);
+
+    __m512d sin_lat = approx_sin_avx512(_mm512_mul_pd(d_lat, half));
+    __m512d sin_lon = approx_sin_avx512(_mm512_mul_pd(d_lon, half));
+    __m512d cos1    = approx_sin_avx512(_mm512_add_pd(lat1, half_pi));
+    __m512d cos2    = approx_sin_avx512(_mm512_add_pd(lat2, half_pi));
+
+    __m512d a = _mm512_mul_pd(_mm512_mul_pd(cos1, cos2), _mm512_mul_pd(sin_lon, sin_lon));
+    a = _mm512_fmadd_pd(sin_lat, sin_lat, a);
+    a = _mm512_min_pd(a, one);
+
+    __m512d c = approx_asin_avx512(_mm512_sqrt_pd(a));
+
+    _mm512_storeu_pd(out + i, _mm512_mul_pd(diameter, c));
+  }
+
+  haversine_batch_scalar(x0 + wide_count, y0 + wide_count, x1 + wide_count, y1 + wide_count,
+                         count - wide_count, out + wide_count);
+}
+
+// Dispatch ---
+
+static
+Haversine_Batch_Function *haversine_batch_select(void)
+{
+  Haversine_Batch_Function *result = haversine_batch_scalar;
+
+  if (__builtin_cpu_supports("avx512f"))
+  {
+    result = haversine_batch_avx512;
+  }
+  else if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+  {
+    result = haversine_batch_avx2;
+  }
+
+  return result;
+}
+
+static
+const char *haversine_batch_name(Haversine_Batch_Function *function)
+{
+  return function == haversine_batch_avx512 ? "avx512" :
+         function == haversine_batch_avx2   ? "avx2"   : "scalar";
+}
+
+static
+void haversine_batch(const f64 *x0, const f64 *y0, const f64 *x1, const f64 *y1, usize count, f64 *out)
+{
+  // Called from every sum thread at once. They'd all pick the same one, so racing on the first call
+  // just selects it more than once, the atomics only keep that from being a data race
+  static Haversine_Batch_Function *selected = NULL;
+  Haversine_Batch_Function *function = __atomic_load_n(&selected, __ATOMIC_RELAXED);
+  if (!function)
+  {
+    function = haversine_batch_select();
+    __atomic_store_n(&selected, function, __ATOMIC_RELAXED);
+  }
+
+  function(x0, y0, x1, y1, count, out);
+}
+
+// Block sums ---
+
+// One block's worth of the sum pass, see HAVERSINE_SUM_BLOCK_PAIRS
+static
+f64 haversine_block_sum_columns(Haversine_Pair_Columns *columns, usize first, usize close, b32 use_batch)
+{
+  f64 result = 0.0;
+
+  if (use_batch)
+  {
+    f64 out[256];
+    for (usize at = first; at < close; at += STATIC_COUNT(out))
+    {
+      usize count = MIN(STATIC_COUNT(out), close - at);
+
+      haversine_batch(columns->x0 + at, columns->y0 + at, columns->x1 + at, columns->y1 + at, count, out);
+
+      for (usize i = 0; i < count; i++)
+      {
+        result += out[i];
+      }
+    }
+  }
+  else
+  {
+    for (usize i = first; i < close; i++)
+    {
+      result += reference_haversine(columns->x0[i], columns->y0[i], columns->x1[i], columns->y1[i], HAVERSINE_EARTH_RADIUS);
+    }
+  }
+
+  return result;
+}
+
+// Array of structs version, mostly around to compare against
+static
+f64 haversine_block_sum_pairs(Haversine_Pair *pairs, usize first, usize close, b32 use_batch)
+{
+  f64 result = 0.0;
+
+  if (use_batch)
+  {
+    // Pull the pairs apart into columns a bit at a time for the batch kernel
+    f64 x0[256], y0[256], x1[256], y1[256], out[256];
+    for (usize at = first; at < close; at += STATIC_COUNT(out))
+    {
+      usize count = MIN(STATIC_COUNT(out), close - at);
+      for (usize i = 0; i < count; i++)
+      {
+        Haversine_Pair pair = pairs[at + i];
+        x0[i] = pair.x0;
+        y0[i] = pair.y0;
+        x1[i] = pair.x1;
+        y1[i] = pair.y1;
+      }
+
+      haversine_batch(x0, y0, x1, y1, count, out);
+
+      for (usize i = 0; i < count; i++)
+      {
+        result += out[i];
+      }
+    }
+  }
+  else
+  {
+    for (usize i = first; i < close; i++)
+    {
+      Haversine_Pair pair = pairs[i];
+      result += reference_haversine(pair.x0, pair.y0, pair.x1, pair.y1, HAVERSINE_EARTH_RADIUS);
+    }
+  }
+
+  return result;
+}
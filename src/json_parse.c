@@ -26,6 +26,7 @@ struct JSON_Token
 };
 
 typedef struct JSON_Object JSON_Object;
+typedef struct JSON_Key_Index JSON_Key_Index;
 struct JSON_Object
 {
   String key;   // Not required for arrays, or the outer most object
@@ -35,12 +36,131 @@ struct JSON_Object
   JSON_Object *next_sibling;
 };
 
+// Objects and arrays are allocated as this, so leaves don't pay for the index pointer. Anything with a
+// first_child is one of these, and value is then its opening brace
+typedef struct JSON_Container JSON_Container;
+struct JSON_Container
+{
+  JSON_Object    object;
+  JSON_Key_Index *key_index; // Only for wide objects once indexed, see json_index_keys()
+};
+
+static
+JSON_Key_Index *json_key_index(JSON_Object *object)
+{
+  return object->first_child ? ((JSON_Container *)object)->key_index : NULL;
+}
+
+// Objects narrower than this are quicker to just scan
+#define JSON_KEY_INDEX_MIN_CHILDREN 16
+
+// Open addressing, linear probing. Sibling list still there for going through in order
+typedef struct JSON_Key_Slot JSON_Key_Slot;
+struct JSON_Key_Slot
+{
+  u32         hash;
+  JSON_Object *child; // NULL when empty
+};
+
+struct JSON_Key_Index
+{
+  JSON_Key_Slot *slots;
+  u32           mask; // Slot count is a power of 2
+};
+
+typedef enum JSON_Parse_Flags
+{
+  JSON_PARSE_NONE       = 0,
+  JSON_PARSE_INDEX_KEYS = (1 << 0), // Index every wide object up front instead of on first lookup
+} JSON_Parse_Flags;
+
+// Streaming mode, no tree gets built, just events as they're parsed
+#define JSON_Event_Type(X)       \
+  X(JSON_EVENT_BEGIN_OBJECT)     \
+  X(JSON_EVENT_CLOSE_OBJECT)     \
+  X(JSON_EVENT_BEGIN_ARRAY)      \
+  X(JSON_EVENT_CLOSE_ARRAY)      \
+  X(JSON_EVENT_VALUE)            \
+  X(JSON_EVENT_COUNT)
+
+ENUM_TABLE(JSON_Event_Type);
+
+typedef struct JSON_Event JSON_Event;
+struct JSON_Event
+{
+  JSON_Event_Type type;
+  String          key;   // Empty for array members, the outer most object, and close events
+  JSON_Token      value; // Only for JSON_EVENT_VALUE
+  usize           depth; // Outer most object is 0
+};
+
+typedef void JSON_Event_Function(JSON_Event *event, void *user_data);
+
+// Overlapped reading, a helper thread loads the next chunks while the parser works through the current one
+#define JSON_READER_BUFFER_COUNT 4
+#define JSON_READER_LOOKAHEAD    KB(64) // Longest token that may straddle two chunks, anything longer is a parse error
+
+typedef struct JSON_Reader_Stats JSON_Reader_Stats;
+struct JSON_Reader_Stats
+{
+  u64   bytes_read;
+  u64   read_cycles; // Only time spent in fread on the helper thread
+  usize chunk_count;
+};
+
+typedef struct JSON_Reader JSON_Reader;
+struct JSON_Reader
+{
+  FILE  *file;
+  usize file_size;
+  usize chunk_size;
+
+  // Every buffer has JSON_READER_LOOKAHEAD bytes of room in front of the chunk for the carried over tail
+  u8    *buffers[JSON_READER_BUFFER_COUNT];
+  usize filled[JSON_READER_BUFFER_COUNT];
+
+  OS_Semaphore empty_count; // Buffers the helper thread may fill
+  OS_Semaphore full_count;  // Buffers the parser may take
+
+  usize current;
+  usize held_count; // Parser keeps the previous buffer too, so a key from just before a switch stays valid
+  b32   finished;
+  b32   stop;       // Parser gave up early, helper thread should quit
+
+  JSON_Reader_Stats stats;
+};
+
+// Stage one, classifies 64 bytes at a time and hands the tokenizer positions of structurals
+// ({}[]:,), both quotes of every string, and the first byte of every number or literal
+#define JSON_SCAN_BLOCK_BYTES 64
+#define JSON_SCAN_BATCH_BYTES KB(2) // Scanned ahead of the tokenizer at a time, keeps the index tiny
+
+typedef struct JSON_Scanner JSON_Scanner;
+struct JSON_Scanner
+{
+  usize scanned; // Bytes of source classified so far
+
+  // Carried between blocks, all ones or zero apart from prev_escaped which is just bit 0
+  u64   prev_escaped;
+  u64   prev_in_string;
+  u64   prev_scalar;
+
+  usize positions[JSON_SCAN_BATCH_BYTES + 8]; // Room for the extraction to overshoot
+  usize count;
+  usize next;
+};
+
 typedef struct JSON_Parser JSON_Parser;
 struct JSON_Parser
 {
   String source;
   usize  at;
   b32    had_error;
+
+  JSON_Reader  *reader;  // Only set when streaming from a file in chunks
+  JSON_Scanner *scanner; // Only set when the whole source is in memory, jumps straight between tokens
+
+  JSON_Parse_Flags flags;
 };
 
 static
@@ -75,27 +195,385 @@ b8 parser_token_is_literal(JSON_Parser *parser, String literal_string)
   return MEM_MATCH(parser_at(parser), literal_string.v, literal_string.count);
 }
 
+static
+void *json_reader_thread(void *params)
+{
+  JSON_Reader *reader = (JSON_Reader *)params;
+
+  profile_set_thread_name("json reader");
+
+  usize write = 0;
+  while (true)
+  {
+    os_semaphore_wait(reader->empty_count);
+    if (reader->stop)
+    {
+      break;
+    }
+
+    usize read_count = 0;
+    u64 start = read_cpu_timer();
+    PROFILE_SCOPE_BANDWIDTH("json read", MIN(reader->chunk_size, reader->file_size - MIN(reader->stats.bytes_read, reader->file_size)))
+    {
+      read_count = fread(reader->buffers[write] + JSON_READER_LOOKAHEAD, 1, reader->chunk_size, reader->file);
+    }
+    reader->stats.read_cycles += read_cpu_timer() - start;
+    reader->stats.bytes_read  += read_count;
+
+    // Empty chunk tells the parser we hit the end
+    reader->filled[write] = read_count;
+    os_semaphore_signal(reader->full_count);
+
+    if (read_count == 0)
+    {
+      break;
+    }
+
+    reader->stats.chunk_count += 1;
+    write = (write + 1) % JSON_READER_BUFFER_COUNT;
+  }
+
+  return NULL;
+}
+
+// Called at token boundaries only. Once we get close to the end of the current chunk, carry the
+// unparsed tail to the front of the next one so no token ever has to straddle two buffers
+static
+void json_reader_refill(JSON_Parser *parser)
+{
+  JSON_Reader *reader = parser->reader;
+
+  usize remaining = parser->source.count - parser->at;
+  if (reader->finished || remaining >= JSON_READER_LOOKAHEAD)
+  {
+    return;
+  }
+
+  usize next = (reader->current + 1) % JSON_READER_BUFFER_COUNT;
+  if (reader->held_count == 0)
+  {
+    next = 0; // Very first chunk
+  }
+
+  PROFILE_SCOPE("json io wait")
+  {
+    os_semaphore_wait(reader->full_count);
+  }
+
+  if (reader->filled[next] == 0)
+  {
+    reader->finished = true;
+  }
+  else
+  {
+    u8 *start = reader->buffers[next] + JSON_READER_LOOKAHEAD - remaining;
+    MEM_COPY(start, parser->source.v + parser->at, remaining);
+
+    parser->source.v     = start;
+    parser->source.count = remaining + reader->filled[next];
+    parser->at           = 0;
+
+    // Give back the one before the current, the current becomes the previous
+    if (reader->held_count == 2)
+    {
+      os_semaphore_signal(reader->empty_count);
+    }
+    else
+    {
+      reader->held_count += 1;
+    }
+    reader->current = next;
+  }
+}
+
+// Stage one scanning ---
+
+#include <immintrin.h>
+
+#define JSON_TARGET_AVX2 __attribute__((target("avx2,bmi,popcnt")))
+#define JSON_INLINE_AVX2 __attribute__((target("avx2,bmi,popcnt"), always_inline))
+
+typedef struct JSON_Block_Masks JSON_Block_Masks;
+struct JSON_Block_Masks
+{
+  u64 structural; // {}[]:,
+  u64 whitespace;
+  u64 quote;
+  u64 backslash;
+};
+
+// Bit i set if byte i is escaped, works for any run length of backslashes and across blocks
+static inline
+u64 json_find_escaped(u64 backslash, u64 *prev_escaped)
+{
+  backslash &= ~*prev_escaped;
+  u64 follows_escape = (backslash << 1) | *prev_escaped;
+
+  // Runs that start on an odd bit flip parity of which bits are escaped at the end of the run
+  u64 even_bits = 0x5555555555555555ull;
+  u64 odd_sequence_starts = backslash & ~even_bits & ~follows_escape;
+
+  u64 sequences_starting_on_even_bits = 0;
+  *prev_escaped = __builtin_add_overflow(odd_sequence_starts, backslash, &sequences_starting_on_even_bits);
+
+  u64 invert_mask = sequences_starting_on_even_bits << 1;
+  return (even_bits ^ invert_mask) & follows_escape;
+}
+
+// Bit i becomes the xor of bits 0 to i, so everything from an opening quote up to (not including) the closing one
+static inline
+u64 json_prefix_xor(u64 bits)
+{
+  bits ^= bits << 1;
+  bits ^= bits << 2;
+  bits ^= bits << 4;
+  bits ^= bits << 8;
+  bits ^= bits << 16;
+  bits ^= bits << 32;
+  return bits;
+}
+
+static inline
+void json_scan_masks(JSON_Scanner *scanner, JSON_Block_Masks masks, usize base)
+{
+  u64 escaped = json_find_escaped(masks.backslash, &scanner->prev_escaped);
+  u64 quote   = masks.quote & ~escaped;
+
+  u64 in_string = json_prefix_xor(quote) ^ scanner->prev_in_string;
+  scanner->prev_in_string = (u64)((i64)in_string >> 63);
+
+  u64 structural = masks.structural & ~in_string;
+
+  // Numbers and literals, only want the first byte of each
+  u64 scalar = ~(masks.structural | masks.whitespace | quote) & ~in_string;
+  u64 scalar_start = scalar & ~((scalar << 1) | scanner->prev_scalar);
+  scanner->prev_scalar = scalar >> 63;
+
+  // Always write 8 at a time, garbage past bit_count gets overwritten by the next block. Far fewer
+  // mispredicts than a loop that exits exactly on the last bit
+  u64 bits = structural | quote | scalar_start;
+  usize *out = scanner->positions + scanner->count;
+  usize bit_count = __builtin_popcountll(bits);
+  for (usize i = 0; i < bit_count; i += 8)
+  {
+    #pragma GCC unroll 8
+    for (usize j = 0; j < 8; j++)
+    {
+      out[i + j] = base + __builtin_ctzll(bits | (1ull << 63)); // Keeps ctz defined once bits run out
+      bits &= bits - 1;
+    }
+  }
+  scanner->count += bit_count;
+}
+
+static inline
+JSON_Block_Masks json_classify_block_scalar(const u8 *block)
+{
+  JSON_Block_Masks masks = {0};
+
+  for (usize i = 0; i < JSON_SCAN_BLOCK_BYTES; i++)
+  {
+    u64 bit = 1ull << i;
+    switch (block[i])
+    {
+      case '{': case '}': case '[': case ']': case ':': case ',':
+        masks.structural |= bit;
+        break;
+      case ' ': case '\n': case '\r': case '\t':
+        masks.whitespace |= bit;
+        break;
+      case '"':
+        masks.quote |= bit;
+        break;
+      case '\\':
+        masks.backslash |= bit;
+        break;
+    }
+  }
+
+  return masks;
+}
+
+static inline JSON_INLINE_AVX2
+u64 json_match_avx2(__m256i lo, __m256i hi, u8 ch)
+{
+  __m256i splat = _mm256_set1_epi8((char)ch);
+  u64 low  = (u32)_mm256_movemask_epi8(_mm256_cmpeq_epi8(lo, splat));
+  u64 high = (u32)_mm256_movemask_epi8(_mm256_cmpeq_epi8(hi, splat));
+  return low | (high << 32);
+}
+
+static inline JSON_INLINE_AVX2
+JSON_Block_Masks json_classify_block_avx2(const u8 *block)
+{
+  __m256i lo = _mm256_loadu_si256((const __m256i *)block);
+  __m256i hi = _mm256_loadu_si256((const __m256i *)(block + 32));
+
+  JSON_Block_Masks masks =
+  {
+    .structural = json_match_avx2(lo, hi, '{') | json_match_avx2(lo, hi, '}') |
+                  json_match_avx2(lo, hi, '[') | json_match_avx2(lo, hi, ']') |
+                  json_match_avx2(lo, hi, ':') | json_match_avx2(lo, hi, ','),
+    .whitespace = json_match_avx2(lo, hi, ' ')  | json_match_avx2(lo, hi, '\n') |
+                  json_match_avx2(lo, hi, '\r') | json_match_avx2(lo, hi, '\t'),
+    .quote      = json_match_avx2(lo, hi, '"'),
+    .backslash  = json_match_avx2(lo, hi, '\\'),
+  };
+
+  return masks;
+}
+
+typedef void JSON_Scan_Function(JSON_Scanner *scanner, String source);
+
+// The partial block at the very end is padded with spaces so it doesn't produce anything extra
+#define JSON_SCAN_BATCH_BODY(classify)                                                   \
+  usize close = MIN(scanner->scanned + JSON_SCAN_BATCH_BYTES, source.count);             \
+  while (scanner->scanned < close)                                                       \
+  {                                                                                      \
+    JSON_Block_Masks masks;                                                              \
+    if (scanner->scanned + JSON_SCAN_BLOCK_BYTES <= source.count)                        \
+    {                                                                                    \
+      masks = classify(source.v + scanner->scanned);                                     \
+    }                                                                                    \
+    else                                                                                 \
+    {                                                                                    \
+      u8 padded[JSON_SCAN_BLOCK_BYTES];                                                  \
+      MEM_SET(padded, sizeof(padded), ' ');                                              \
+      MEM_COPY(padded, source.v + scanner->scanned, source.count - scanner->scanned);    \
+      masks = classify(padded);                                                          \
+    }                                                                                    \
+    json_scan_masks(scanner, masks, scanner->scanned);                                   \
+    scanner->scanned += JSON_SCAN_BLOCK_BYTES;                                           \
+  }                                                                                      \
+  scanner->scanned = MIN(scanner->scanned, source.count);
+
+static
+void json_scan_batch_scalar(JSON_Scanner *scanner, String source)
+{
+  JSON_SCAN_BATCH_BODY(json_classify_block_scalar);
+}
+
+static JSON_TARGET_AVX2
+void json_scan_batch_avx2(JSON_Scanner *scanner, String source)
+{
+  JSON_SCAN_BATCH_BODY(json_classify_block_avx2);
+}
+
+static
+JSON_Scan_Function *json_scan_select(void)
+{
+  b32 has_avx2 = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("bmi") && __builtin_cpu_supports("popcnt");
+  return has_avx2 ? json_scan_batch_avx2 : json_scan_batch_scalar;
+}
+
+// Returns false once all the source has been scanned and there's nothing left
+static
+b32 parser_scan_batch(JSON_Parser *parser)
+{
+  // Parsers on several threads can all get here first, relaxed is enough since they pick the same scan
+  static JSON_Scan_Function *selected = NULL;
+  JSON_Scan_Function *scan = __atomic_load_n(&selected, __ATOMIC_RELAXED);
+  if (!scan)
+  {
+    scan = json_scan_select();
+    __atomic_store_n(&selected, scan, __ATOMIC_RELAXED);
+  }
+
+  JSON_Scanner *scanner = parser->scanner;
+  while (scanner->next == scanner->count)
+  {
+    if (scanner->scanned >= parser->source.count)
+    {
+      return false;
+    }
+
+    scanner->count = 0;
+    scanner->next  = 0;
+    scan(scanner, parser->source);
+  }
+
+  return true;
+}
+
+// Next token start without consuming it
+static inline
+b32 parser_peek_structural(JSON_Parser *parser, usize *position)
+{
+  JSON_Scanner *scanner = parser->scanner;
+
+  b32 result = scanner->next < scanner->count || parser_scan_batch(parser);
+  if (result)
+  {
+    *position = scanner->positions[scanner->next];
+  }
+
+  return result;
+}
+
+static inline
+b32 parser_next_structural(JSON_Parser *parser, usize *position)
+{
+  b32 result = parser_peek_structural(parser, position);
+  parser->scanner->next += result;
+  return result;
+}
+
 static
 b32 is_numeric(u8 ch)
 {
   return char_is_digit(ch) || ch == '.' || ch == '-';
 }
 
+// Token ran off the end of what's in memory. When streaming that's a token longer than the carried over
+// look ahead, otherwise it never got closed
 static
-JSON_Token get_json_token(JSON_Parser *parser)
+void parser_report_cut_token(JSON_Parser *parser, JSON_Token *token)
+{
+  if (parser->reader && !parser->reader->finished)
+  {
+    LOG_ERROR("Json %s token longer than JSON_READER_LOOKAHEAD (%lu KB) while streaming, can't carry it over to the next chunk",
+              JSON_Token_Type_strings[token->type], (usize)JSON_READER_LOOKAHEAD / KB(1));
+  }
+  else
+  {
+    LOG_ERROR("Unterminated json %s token at the end of the source", JSON_Token_Type_strings[token->type]);
+  }
+
+  parser->had_error = true;
+  token->type = JSON_TOKEN_EOF; // Don't hand back half a token
+}
+
+static
+JSON_Token get_json_token_bytewise(JSON_Parser *parser)
 {
   JSON_Token token = {0};
 
-  // Eat white spaces
-  while (parser_incomplete(parser)  &&
-         (*parser_at(parser) == ' '  ||
-          *parser_at(parser) == '\n' ||
-          *parser_at(parser) == '\r' ||
-          *parser_at(parser) == '\t'))
+  // Refill again once past the white space, so the token itself gets the whole look ahead, and a run
+  // of white space longer than what's left of the chunk isn't mistaken for the end of the file
+  b32 refill = parser->reader != NULL;
+  do
   {
-    // TODO: Probably just count all white space and then advance once for all at the end
-    parser_advance(parser, 1);
-  }
+    if (refill)
+    {
+      json_reader_refill(parser);
+    }
+
+    // Eat white spaces
+    while (parser_incomplete(parser)  &&
+           (*parser_at(parser) == ' '  ||
+            *parser_at(parser) == '\n' ||
+            *parser_at(parser) == '\r' ||
+            *parser_at(parser) == '\t'))
+    {
+      // TODO: Probably just count all white space and then advance once for all at the end
+      parser_advance(parser, 1);
+    }
+
+    if (refill)
+    {
+      json_reader_refill(parser);
+    }
+  } while (refill && parser->at >= parser->source.count && !parser->reader->finished && !parser->had_error);
 
   if (parser_incomplete(parser)) // If we've not reached the end of file
   {
@@ -152,16 +630,24 @@ JSON_Token get_json_token(JSON_Parser *parser)
 
         token.value.v = parser_at(parser); // Special case, we want the start to ignore the "
 
-        // TODO: account for escaped quotes
+        // Escapes are kept as is, just need to not stop on an escaped quote
         usize string_count = 0;
-        while (*parser_at(parser) != '"')
+        while (parser->at < parser->source.count && *parser_at(parser) != '"')
         {
-          string_count += 1;
-          parser_advance(parser, 1);
+          usize advance = *parser_at(parser) == '\\' ? 2 : 1;
+          string_count += advance;
+          parser_advance(parser, advance);
         }
         token.value.count = string_count;
 
-        parser_advance(parser, 1); // For the other quotation mark
+        if (parser->at >= parser->source.count)
+        {
+          parser_report_cut_token(parser, &token);
+        }
+        else
+        {
+          parser_advance(parser, 1); // For the other quotation mark
+        }
       }
       break;
       case '0':
@@ -180,12 +666,18 @@ JSON_Token get_json_token(JSON_Parser *parser)
         token.type  = JSON_TOKEN_NUMBER;
 
         usize digit_count = 0;
-        while (is_numeric(*parser_at(parser)))
+        while (parser->at < parser->source.count && is_numeric(*parser_at(parser)))
         {
           digit_count += 1;
           parser_advance(parser, 1);
         }
         token.value.count = digit_count;
+
+        // Running into the end is fine for a number, unless there's more of the file still to come
+        if (parser->reader && !parser->reader->finished && parser->at >= parser->source.count)
+        {
+          parser_report_cut_token(parser, &token);
+        }
       }
       break;
       case 't':
@@ -193,8 +685,8 @@ JSON_Token get_json_token(JSON_Parser *parser)
         String string = String("true");
         if (parser_token_is_literal(parser, string))
         {
-          // No 'value' for this
           token.type = JSON_TOKEN_TRUE;
+          token.value.count = string.count;
           parser_advance(parser, string.count);
         }
         else
@@ -209,8 +701,8 @@ JSON_Token get_json_token(JSON_Parser *parser)
         String string = String("false");
         if (parser_token_is_literal(parser, string))
         {
-          // No 'value' for this
           token.type = JSON_TOKEN_FALSE;
+          token.value.count = string.count;
           parser_advance(parser, string.count);
         }
         else
@@ -225,8 +717,8 @@ JSON_Token get_json_token(JSON_Parser *parser)
         String string = String("null");
         if (parser_token_is_literal(parser, string))
         {
-          // No 'value' for this
           token.type = JSON_TOKEN_NULL;
+          token.value.count = string.count;
           parser_advance(parser, string.count);
         }
         else
@@ -247,6 +739,101 @@ JSON_Token get_json_token(JSON_Parser *parser)
   return token;
 }
 
+// With a scanner we skip white space and string bodies entirely, numbers and literals are still
+// finished off byte by byte since they're short
+static
+JSON_Token get_json_token(JSON_Parser *parser)
+{
+  if (!parser->scanner)
+  {
+    return get_json_token_bytewise(parser);
+  }
+
+  JSON_Token token = {0};
+
+  usize position = 0;
+  if (!parser_next_structural(parser, &position))
+  {
+    // EOF
+    parser->at = parser->source.count;
+    return token;
+  }
+
+  parser->at = position;
+
+  token.value.v     = parser->source.v + position;
+  token.value.count = 1;
+
+  switch (parser->source.v[position])
+  {
+    case '{': token.type = JSON_TOKEN_OPEN_CURLY_BRACE;   break;
+    case '}': token.type = JSON_TOKEN_CLOSE_CURLY_BRACE;  break;
+    case '[': token.type = JSON_TOKEN_OPEN_SQUARE_BRACE;  break;
+    case ']': token.type = JSON_TOKEN_CLOSE_SQUARE_BRACE; break;
+    case ',': token.type = JSON_TOKEN_COMMA;              break;
+    case ':': token.type = JSON_TOKEN_COLON;              break;
+    case '"':
+    {
+      // Closing quote is always the very next position
+      usize close = 0;
+      if (parser_next_structural(parser, &close))
+      {
+        token.type        = JSON_TOKEN_STRING;
+        token.value.v     = parser->source.v + position + 1;
+        token.value.count = close - position - 1;
+        parser->at        = close;
+      }
+      else
+      {
+        LOG_ERROR("Unterminated string starting at byte %lu", position);
+        parser->had_error = true;
+      }
+    }
+    break;
+    default:
+    {
+      // Numbers and literals run right up to whatever comes next, minus any white space. Actually
+      // checking the digits is left to string_to_f64
+      usize close = parser->source.count;
+      parser_peek_structural(parser, &close);
+      while (close > position && char_is_whitespace(parser->source.v[close - 1]))
+      {
+        close -= 1;
+      }
+      token.value.count = close - position;
+      parser->at        = close - 1;
+
+      u8 first = parser->source.v[position];
+      if (is_numeric(first))
+      {
+        token.type = JSON_TOKEN_NUMBER;
+      }
+      else if (string_match(token.value, String("true")))
+      {
+        token.type = JSON_TOKEN_TRUE;
+      }
+      else if (string_match(token.value, String("false")))
+      {
+        token.type = JSON_TOKEN_FALSE;
+      }
+      else if (string_match(token.value, String("null")))
+      {
+        token.type = JSON_TOKEN_NULL;
+      }
+      else
+      {
+        LOG_ERROR("Encountered unrecognized literal at byte %lu", position);
+        parser->had_error = true;
+      }
+    }
+    break;
+  }
+
+  parser_advance(parser, 1);
+
+  return token;
+}
+
 static
 b32 json_token_type_is_value_type(JSON_Token_Type type)
 {
@@ -262,23 +849,30 @@ static
 JSON_Object *parse_json_children(Arena *arena, JSON_Parser *parser,
                                  JSON_Token_Type end_token, b32 has_keys);
 
+static
+void json_index_keys(Arena *arena, JSON_Object *object);
+
 static
 JSON_Object *parse_json_object(Arena *arena, JSON_Parser *parser, String key, JSON_Token token)
 {
   profile_begin_func();
 
   JSON_Object *first_child = NULL;
+  b32         has_keys    = false;
+  b32         is_container = false;
 
   if (token.type == JSON_TOKEN_OPEN_CURLY_BRACE)
   {
     // Normal key : value pairs
-    b32 has_keys = true;
+    has_keys = true;
+    is_container = true;
     first_child = parse_json_children(arena, parser, JSON_TOKEN_CLOSE_CURLY_BRACE, has_keys);
   }
   else if (token.type == JSON_TOKEN_OPEN_SQUARE_BRACE)
   {
     // Array, no key
-    b32 has_keys = false;
+    has_keys = false;
+    is_container = true;
     first_child = parse_json_children(arena, parser, JSON_TOKEN_CLOSE_SQUARE_BRACE, has_keys);
   }
   // else it should be a leaf node containing a value only, not an array or table
@@ -292,12 +886,17 @@ JSON_Object *parse_json_object(Arena *arena, JSON_Parser *parser, String key, JS
     parser->had_error = true;
   }
 
-  JSON_Object *result  = arena_new(arena, JSON_Object);
+  JSON_Object *result = is_container ? &((JSON_Container *)arena_new(arena, JSON_Container))->object : arena_new(arena, JSON_Object);
   result->key          = key;
   result->first_child  = first_child;
   result->next_sibling = NULL;
   result->value        = token.value;
 
+  if (parser->flags & JSON_PARSE_INDEX_KEYS)
+  {
+    json_index_keys(arena, result);
+  }
+
   profile_close_func();
 
   return result;
@@ -390,14 +989,18 @@ JSON_Object *parse_json_children(Arena *arena, JSON_Parser *parser,
 
 // Returns the very first object
 static
-JSON_Object *parse_json(Arena *arena, String source)
+JSON_Object *parse_json(Arena *arena, String source, JSON_Parse_Flags flags)
 {
   profile_begin_func();
 
+  JSON_Scanner scanner = {0};
+
   JSON_Parser parser =
   {
-    .source = source,
-    .at     = 0,
+    .source  = source,
+    .at      = 0,
+    .scanner = &scanner,
+    .flags   = flags,
   };
 
   JSON_Object *outer = parse_json_object(arena, &parser, (String){0}, get_json_token(&parser));
@@ -412,14 +1015,327 @@ JSON_Object *parse_json(Arena *arena, String source)
   return outer;
 }
 
-static
+typedef struct JSON_Stream JSON_Stream;
+struct JSON_Stream
+{
+  JSON_Parser         parser;
+  JSON_Event_Function *callback;
+  void                *user_data;
+};
+
+static
+void stream_json_children(JSON_Stream *stream, JSON_Token_Type end_token, b32 has_keys, usize depth);
+
+static
+void stream_json_value(JSON_Stream *stream, String key, JSON_Token token, usize depth)
+{
+  JSON_Event event =
+  {
+    .key   = key,
+    .depth = depth,
+  };
+
+  if (token.type == JSON_TOKEN_OPEN_CURLY_BRACE)
+  {
+    event.type = JSON_EVENT_BEGIN_OBJECT;
+    stream->callback(&event, stream->user_data);
+
+    b32 has_keys = true;
+    stream_json_children(stream, JSON_TOKEN_CLOSE_CURLY_BRACE, has_keys, depth + 1);
+
+    // The key may point into a reader buffer that has since been released
+    event.type = JSON_EVENT_CLOSE_OBJECT;
+    event.key  = (String){0};
+    stream->callback(&event, stream->user_data);
+  }
+  else if (token.type == JSON_TOKEN_OPEN_SQUARE_BRACE)
+  {
+    event.type = JSON_EVENT_BEGIN_ARRAY;
+    stream->callback(&event, stream->user_data);
+
+    b32 has_keys = false;
+    stream_json_children(stream, JSON_TOKEN_CLOSE_SQUARE_BRACE, has_keys, depth + 1);
+
+    // The key may point into a reader buffer that has since been released
+    event.type = JSON_EVENT_CLOSE_ARRAY;
+    event.key  = (String){0};
+    stream->callback(&event, stream->user_data);
+  }
+  else if (json_token_type_is_value_type(token.type))
+  {
+    event.type  = JSON_EVENT_VALUE;
+    event.value = token;
+    stream->callback(&event, stream->user_data);
+  }
+  else
+  {
+    // Tokenizer already said what went wrong
+    if (!stream->parser.had_error)
+    {
+      LOG_ERROR("Unexpected token type encountered while streaming json: %s, (value = %.*s)", JSON_Token_Type_strings[token.type], String_Format(token.value));
+    }
+    stream->parser.had_error = true;
+  }
+}
+
+// Same shape as parse_json_children, just no allocations
+static
+void stream_json_children(JSON_Stream *stream, JSON_Token_Type end_token, b32 has_keys, usize depth)
+{
+  JSON_Parser *parser = &stream->parser;
+
+  while (parser_incomplete(parser))
+  {
+    JSON_Token key_token = {0};
+    JSON_Token value_token = {0};
+
+    if (has_keys)
+    {
+      key_token = get_json_token(parser);
+
+      // Empty object
+      if (key_token.type == end_token)
+      {
+        break;
+      }
+
+      if (key_token.type == JSON_TOKEN_STRING)
+      {
+        JSON_Token expect_colon = get_json_token(parser);
+
+        if (expect_colon.type == JSON_TOKEN_COLON)
+        {
+          value_token = get_json_token(parser);
+        }
+        else
+        {
+          LOG_ERROR("Expected colon after key: %.*s", String_Format(key_token.value));
+          parser->had_error = true;
+        }
+      }
+      else
+      {
+        LOG_ERROR("Unexpected key type: %s, (value = %.*s)", JSON_Token_Type_strings[key_token.type], String_Format(key_token.value));
+        parser->had_error = true;
+      }
+    }
+    else
+    {
+      value_token = get_json_token(parser);
+    }
+
+    if (value_token.type == end_token || parser->had_error)
+    {
+      break;
+    }
+
+    stream_json_value(stream, key_token.value, value_token, depth);
+
+    JSON_Token expect_comma_or_end = get_json_token(parser);
+    if (expect_comma_or_end.type == end_token)
+    {
+      break;
+    }
+    else if (expect_comma_or_end.type != JSON_TOKEN_COMMA)
+    {
+      LOG_ERROR("Expected comma, parsed Token :: Type = %s, Value = '%.*s'", JSON_Token_Type_strings[expect_comma_or_end.type],
+                String_Format(expect_comma_or_end.value));
+      parser->had_error = true;
+    }
+  }
+}
+
+// Single pass, calls back for every object, array, and value as it goes. Returns false on malformed input
+static
+b32 stream_json(String source, JSON_Event_Function *callback, void *user_data)
+{
+  profile_begin_func();
+
+  JSON_Scanner scanner = {0};
+
+  JSON_Stream stream =
+  {
+    .parser =
+    {
+      .source  = source,
+      .at      = 0,
+      .scanner = &scanner,
+    },
+    .callback  = callback,
+    .user_data = user_data,
+  };
+
+  stream_json_value(&stream, (String){0}, get_json_token(&stream.parser), 0);
+
+  profile_close_func();
+
+  return !stream.parser.had_error;
+}
+
+// Same as stream_json, but the file is read in chunks on a helper thread while we parse. Only the
+// time spent waiting on that thread shows up in the 'json io wait' zone, the rest is parsing
+static
+b32 stream_json_file(String name, usize chunk_size, JSON_Event_Function *callback, void *user_data, JSON_Reader_Stats *stats)
+{
+  profile_begin_func();
+
+  b32 result = false;
+
+  char _name[4096] = {0}; // Ugh
+  MEM_COPY(_name, name.v, MIN(name.count, sizeof(_name) - 1));
+
+  JSON_Reader reader =
+  {
+    .file       = fopen(_name, "rb"),
+    .file_size  = file_size(_name),
+    .chunk_size = MAX(chunk_size, JSON_READER_LOOKAHEAD),
+  };
+
+  if (reader.file)
+  {
+    usize buffer_size = JSON_READER_LOOKAHEAD + reader.chunk_size;
+    for (usize i = 0; i < JSON_READER_BUFFER_COUNT; i++)
+    {
+      reader.buffers[i] = (u8 *)os_allocate(buffer_size, OS_ALLOCATION_COMMIT);
+    }
+
+    reader.empty_count = os_semaphore_make(JSON_READER_BUFFER_COUNT);
+    reader.full_count  = os_semaphore_make(0);
+
+    OS_Thread thread = os_thread_launch(json_reader_thread, &reader);
+
+    JSON_Stream stream =
+    {
+      .parser =
+      {
+        .reader = &reader,
+      },
+      .callback  = callback,
+      .user_data = user_data,
+    };
+
+    stream_json_value(&stream, (String){0}, get_json_token(&stream.parser), 0);
+
+    result = !stream.parser.had_error;
+
+    // Might have bailed before the end, make sure the helper isn't stuck waiting on us
+    reader.stop = true;
+    for (usize i = 0; i < JSON_READER_BUFFER_COUNT; i++)
+    {
+      os_semaphore_signal(reader.empty_count);
+    }
+    os_thread_join(thread);
+
+    if (stats)
+    {
+      *stats = reader.stats;
+    }
+
+    os_semaphore_free(&reader.empty_count);
+    os_semaphore_free(&reader.full_count);
+    for (usize i = 0; i < JSON_READER_BUFFER_COUNT; i++)
+    {
+      os_deallocate(reader.buffers[i], buffer_size);
+    }
+    fclose(reader.file);
+  }
+  else
+  {
+    LOG_ERROR("Unable to open file '%.*s' for streaming", String_Format(name));
+  }
+
+  profile_close_func();
+
+  return result;
+}
+
+// Doesn't do anything for arrays or narrow objects. First of any duplicate keys wins, same as
+// the linear scan
+static
+void json_index_keys(Arena *arena, JSON_Object *object)
+{
+  // Only containers have children, and only objects have a curly brace for a value
+  if (!object || !object->first_child || object->value.v[0] != '{' || json_key_index(object))
+  {
+    return;
+  }
+
+  // Narrow objects get looked at on every lazy lookup, so stop counting as soon as it's clear
+  u32 child_count = 0;
+  JSON_Object *counted = object->first_child;
+  for (; counted && child_count < JSON_KEY_INDEX_MIN_CHILDREN; counted = counted->next_sibling)
+  {
+    child_count += 1;
+  }
+
+  if (child_count < JSON_KEY_INDEX_MIN_CHILDREN)
+  {
+    return;
+  }
+
+  profile_begin_func();
+
+  for (; counted; counted = counted->next_sibling)
+  {
+    child_count += 1;
+  }
+
+  // At most half full
+  u32 slot_count = 1;
+  while (slot_count < 2 * child_count)
+  {
+    slot_count <<= 1;
+  }
+
+  JSON_Key_Index *index = arena_new(arena, JSON_Key_Index);
+  index->slots = arena_calloc(arena, slot_count, JSON_Key_Slot);
+  index->mask  = slot_count - 1;
+
+  for (JSON_Object *cursor = object->first_child; cursor; cursor = cursor->next_sibling)
+  {
+    u32 hash = string_hash_u32(cursor->key);
+
+    u32 slot_idx = hash & index->mask;
+    while (index->slots[slot_idx].child &&
+           !(index->slots[slot_idx].hash == hash && string_match(index->slots[slot_idx].child->key, cursor->key)))
+    {
+      slot_idx = (slot_idx + 1) & index->mask;
+    }
+
+    if (!index->slots[slot_idx].child)
+    {
+      index->slots[slot_idx].hash  = hash;
+      index->slots[slot_idx].child = cursor;
+    }
+  }
+
+  ((JSON_Container *)object)->key_index = index;
+
+  profile_close_func();
+}
+
+static
 JSON_Object *lookup_json_object(JSON_Object *current, String key)
 {
   profile_begin_func();
 
   JSON_Object *result = NULL;
 
-  if (current)
+  JSON_Key_Index *index = current ? json_key_index(current) : NULL;
+  if (index)
+  {
+    u32 hash = string_hash_u32(key);
+    for (u32 slot_idx = hash & index->mask; index->slots[slot_idx].child; slot_idx = (slot_idx + 1) & index->mask)
+    {
+      JSON_Key_Slot *slot = index->slots + slot_idx;
+      if (slot->hash == hash && string_match(key, slot->child->key))
+      {
+        result = slot->child;
+        break;
+      }
+    }
+  }
+  else if (current)
   {
     for (JSON_Object *cursor = current->first_child; cursor; cursor = cursor->next_sibling)
     {
@@ -436,6 +1352,15 @@ JSON_Object *lookup_json_object(JSON_Object *current, String key)
   return result;
 }
 
+// Same, but indexes the object on the first lookup if it's wide enough to be worth it
+static
+JSON_Object *lookup_json_object_lazy(Arena *arena, JSON_Object *current, String key)
+{
+  json_index_keys(arena, current);
+
+  return lookup_json_object(current, key);
+}
+
 static
 f64 json_object_to_f64(JSON_Object *object)
 {
@@ -443,87 +1368,382 @@ f64 json_object_to_f64(JSON_Object *object)
 
   if (object)
   {
-    String val = object->value;
-    // Get sign.
-    usize at = 0;
+    result = string_to_f64(object->value);
+  }
+
+  return result;
+}
+
+// Tape ---
+//
+// Flat alternative to the JSON_Object tree. Every value is one 16 byte entry in a single array, in
+// source order, with offsets into the source instead of pointers. Object members are a key entry
+// followed by the value entry. Going over siblings is just jumping ahead with 'next'
+
+#define JSON_TAPE_NONE UINT32_MAX
+#define JSON_TAPE_GROW KB(4) // Entries
+
+typedef struct JSON_Tape_Entry JSON_Tape_Entry;
+struct JSON_Tape_Entry
+{
+  u32 type;   // JSON_Token_Type, containers use the open brace, keys are strings
+  u32 offset; // Into source, for containers that's the open brace
+  u32 count;  // Bytes, or members for containers
+  u32 next;   // One past this entry's subtree, so its next sibling (or its value if this is a key)
+};
+
+typedef struct JSON_Tape JSON_Tape;
+struct JSON_Tape
+{
+  String          source; // Has to outlive the tape
+  JSON_Tape_Entry *entries;
+  u32             count;
+  u32             capacity;
+};
 
-    f64 sign = 1.0;
-    if (val.count > at && val.v[at] == '-')
+typedef struct JSON_Tape_Parser JSON_Tape_Parser;
+struct JSON_Tape_Parser
+{
+  JSON_Parser parser;
+  Arena       *arena;
+  JSON_Tape   *tape;
+};
+
+// Nothing else allocates out of the arena while we build, so growing just keeps extending the same run
+static
+u32 json_tape_push(JSON_Tape_Parser *builder, JSON_Token_Type type, String value)
+{
+  JSON_Tape *tape = builder->tape;
+
+  if (tape->count == tape->capacity)
+  {
+    JSON_Tape_Entry *more = arena_calloc(builder->arena, JSON_TAPE_GROW, JSON_Tape_Entry);
+    if (!tape->entries)
     {
-      sign = -1.0;
-      at += 1;
+      tape->entries = more;
     }
+    ASSERT(more == tape->entries + tape->capacity, "Tape must be contiguous in the arena");
+    tape->capacity += JSON_TAPE_GROW;
+  }
+
+  u32 index = tape->count;
+  tape->count += 1;
+
+  JSON_Tape_Entry *entry = tape->entries + index;
+  entry->type   = type;
+  entry->offset = (u32)(value.v - builder->parser.source.v);
+  entry->count  = (u32)value.count;
+  entry->next   = index + 1;
+
+  return index;
+}
+
+static
+void tape_json_children(JSON_Tape_Parser *builder, u32 container, JSON_Token_Type end_token, b32 has_keys);
+
+static
+void tape_json_value(JSON_Tape_Parser *builder, JSON_Token token)
+{
+  u32 index = json_tape_push(builder, token.type, token.value);
+
+  if (token.type == JSON_TOKEN_OPEN_CURLY_BRACE)
+  {
+    b32 has_keys = true;
+    tape_json_children(builder, index, JSON_TOKEN_CLOSE_CURLY_BRACE, has_keys);
+  }
+  else if (token.type == JSON_TOKEN_OPEN_SQUARE_BRACE)
+  {
+    b32 has_keys = false;
+    tape_json_children(builder, index, JSON_TOKEN_CLOSE_SQUARE_BRACE, has_keys);
+  }
+  else if (!json_token_type_is_value_type(token.type))
+  {
+    LOG_ERROR("Unexpected token type encountered while parsing json tape: %s, (value = %.*s)", JSON_Token_Type_strings[token.type], String_Format(token.value));
+    builder->parser.had_error = true;
+  }
 
-    // Before decimal
-    while (at < val.count)
+  builder->tape->entries[index].next = builder->tape->count;
+}
+
+// Same shape as stream_json_children
+static
+void tape_json_children(JSON_Tape_Parser *builder, u32 container, JSON_Token_Type end_token, b32 has_keys)
+{
+  JSON_Parser *parser = &builder->parser;
+
+  u32 member_count = 0;
+
+  while (parser_incomplete(parser))
+  {
+    JSON_Token key_token = {0};
+    JSON_Token value_token = {0};
+
+    if (has_keys)
     {
-      u8 digit = val.v[at] - (u8)'0';
-      if (digit < 10)
-      {
-        // We go left to right so each previous result is 10 times bigger
-        result = 10 * result + (f64)digit;
-        at += 1;
-      }
-      else // Not a digit
+      key_token = get_json_token(parser);
+
+      // Empty object
+      if (key_token.type == end_token)
       {
         break;
       }
-    }
-
-    // After decimal (if there)
-    if (at < val.count && val.v[at] == '.')
-    {
-      at += 1;
 
-      f64 factor = 1.0 / 10.0;
-      while (at < val.count)
+      if (key_token.type == JSON_TOKEN_STRING)
       {
-        u8 digit = val.v[at] - (u8)'0';
-        if (digit < 10)
+        JSON_Token expect_colon = get_json_token(parser);
+
+        if (expect_colon.type == JSON_TOKEN_COLON)
         {
-          // We go left to right so each additional digit is 10 times smaller
-          result = result + factor * (f64)digit;
-          factor *= 1.0 / 10.0;
-          at += 1;
+          value_token = get_json_token(parser);
         }
-        else // Not a digit
+        else
         {
-          break;
+          LOG_ERROR("Expected colon after key: %.*s", String_Format(key_token.value));
+          parser->had_error = true;
         }
       }
+      else
+      {
+        LOG_ERROR("Unexpected key type: %s, (value = %.*s)", JSON_Token_Type_strings[key_token.type], String_Format(key_token.value));
+        parser->had_error = true;
+      }
+    }
+    else
+    {
+      value_token = get_json_token(parser);
     }
 
-    // Exponent
-    if (at < val.count && (val.v[at] == 'e' || val.v[at] == 'E'))
+    if (value_token.type == end_token || parser->had_error)
     {
-      at += 1;
+      break;
+    }
+
+    if (has_keys)
+    {
+      json_tape_push(builder, JSON_TOKEN_STRING, key_token.value);
+    }
+    tape_json_value(builder, value_token);
+    member_count += 1;
 
-      f64 e_sign = 1;
-      if (at < val.count && val.v[at] == '-')
+    JSON_Token expect_comma_or_end = get_json_token(parser);
+    if (expect_comma_or_end.type == end_token)
+    {
+      break;
+    }
+    else if (expect_comma_or_end.type != JSON_TOKEN_COMMA)
+    {
+      LOG_ERROR("Expected comma, parsed Token :: Type = %s, Value = '%.*s'", JSON_Token_Type_strings[expect_comma_or_end.type],
+                String_Format(expect_comma_or_end.value));
+      parser->had_error = true;
+    }
+  }
+
+  builder->tape->entries[container].count = member_count;
+}
+
+// Offsets are 32 bit, so sources over 4 gb need the tree. Returns an empty tape on malformed input
+static
+JSON_Tape parse_json_tape(Arena *arena, String source)
+{
+  profile_begin_func();
+
+  JSON_Tape tape = {.source = source};
+
+  if (source.count >= UINT32_MAX)
+  {
+    LOG_ERROR("Json source too large for a tape (%lu bytes)", source.count);
+  }
+  else
+  {
+    JSON_Scanner scanner = {0};
+
+    JSON_Tape_Parser builder =
+    {
+      .parser =
       {
-        e_sign = -1;
-      }
+        .source  = source,
+        .at      = 0,
+        .scanner = &scanner,
+      },
+      .arena = arena,
+      .tape  = &tape,
+    };
+
+    tape_json_value(&builder, get_json_token(&builder.parser));
 
-      f64 exponent = 0.0;
-      while (at < val.count)
+    if (builder.parser.had_error)
+    {
+      tape.count = 0;
+    }
+
+    // Hand back whatever we over grew by, nothing to pop when the last grow got filled exactly
+    if (tape.capacity > tape.count)
+    {
+      arena_pop(arena, (tape.capacity - tape.count) * sizeof(JSON_Tape_Entry));
+    }
+    tape.capacity = tape.count;
+  }
+
+  profile_close_func();
+
+  return tape;
+}
+
+// Points at a value entry, never a key
+typedef struct JSON_Cursor JSON_Cursor;
+struct JSON_Cursor
+{
+  JSON_Tape *tape;
+  u32       index;   // JSON_TAPE_NONE if nothing here
+  u32       end;     // Parent's 'next', siblings stop here
+  b32       has_key; // Entry right before is the key
+};
+
+static
+JSON_Cursor json_tape_root(JSON_Tape *tape)
+{
+  JSON_Cursor result =
+  {
+    .tape  = tape,
+    .index = tape->count ? 0 : JSON_TAPE_NONE,
+    .end   = tape->count,
+  };
+
+  return result;
+}
+
+static inline
+b32 json_cursor_valid(JSON_Cursor cursor)
+{
+  return cursor.index != JSON_TAPE_NONE;
+}
+
+static inline
+String json_tape_string(JSON_Tape *tape, u32 index)
+{
+  JSON_Tape_Entry *entry = tape->entries + index;
+
+  String result = {.v = tape->source.v + entry->offset, .count = entry->count};
+  return result;
+}
+
+static
+String json_cursor_key(JSON_Cursor cursor)
+{
+  String result = {0};
+
+  if (json_cursor_valid(cursor) && cursor.has_key)
+  {
+    result = json_tape_string(cursor.tape, cursor.index - 1);
+  }
+
+  return result;
+}
+
+// Leaves only, containers give back nothing
+static
+String json_cursor_value(JSON_Cursor cursor)
+{
+  String result = {0};
+
+  if (json_cursor_valid(cursor) && json_token_type_is_value_type(cursor.tape->entries[cursor.index].type))
+  {
+    result = json_tape_string(cursor.tape, cursor.index);
+  }
+
+  return result;
+}
+
+// Members of objects, elements of arrays, 0 for leaves
+static
+u32 json_cursor_child_count(JSON_Cursor cursor)
+{
+  u32 result = 0;
+
+  if (json_cursor_valid(cursor))
+  {
+    JSON_Tape_Entry *entry = cursor.tape->entries + cursor.index;
+    if (entry->type == JSON_TOKEN_OPEN_CURLY_BRACE || entry->type == JSON_TOKEN_OPEN_SQUARE_BRACE)
+    {
+      result = entry->count;
+    }
+  }
+
+  return result;
+}
+
+static
+JSON_Cursor json_cursor_first_child(JSON_Cursor cursor)
+{
+  JSON_Cursor result = {.tape = cursor.tape, .index = JSON_TAPE_NONE};
+
+  if (json_cursor_child_count(cursor))
+  {
+    JSON_Tape_Entry *entry = cursor.tape->entries + cursor.index;
+
+    result.has_key = entry->type == JSON_TOKEN_OPEN_CURLY_BRACE;
+    result.index   = cursor.index + 1 + (result.has_key ? 1 : 0);
+    result.end     = entry->next;
+  }
+
+  return result;
+}
+
+static
+JSON_Cursor json_cursor_next_sibling(JSON_Cursor cursor)
+{
+  JSON_Cursor result = cursor;
+  result.index = JSON_TAPE_NONE;
+
+  if (json_cursor_valid(cursor))
+  {
+    u32 next = cursor.tape->entries[cursor.index].next + (cursor.has_key ? 1 : 0);
+    if (next < cursor.end)
+    {
+      result.index = next;
+    }
+  }
+
+  return result;
+}
+
+// Same as lookup_json_object, but hops over whole subtrees from key to key instead of chasing pointers
+static
+JSON_Cursor lookup_json_cursor(JSON_Cursor cursor, String key)
+{
+  profile_begin_func();
+
+  JSON_Cursor result = {.tape = cursor.tape, .index = JSON_TAPE_NONE};
+
+  if (json_cursor_valid(cursor) && cursor.tape->entries[cursor.index].type == JSON_TOKEN_OPEN_CURLY_BRACE)
+  {
+    JSON_Tape       *tape    = cursor.tape;
+    JSON_Tape_Entry *object  = tape->entries + cursor.index;
+    for (u32 key_idx = cursor.index + 1; key_idx < object->next; key_idx = tape->entries[key_idx + 1].next)
+    {
+      if (string_match(key, json_tape_string(tape, key_idx)))
       {
-        u8 digit = val.v[at] - (u8)'0';
-        if (digit < 10)
-        {
-          // We go left to right so each previous result is 10 times bigger
-          exponent = 10 * exponent + (f64)digit;
-          at += 1;
-        }
-        else // Not a digit
-        {
-          break;
-        }
+        result.index   = key_idx + 1;
+        result.end     = object->next;
+        result.has_key = true;
+        break;
       }
-
-      result *= pow(10.0, e_sign * exponent);
     }
+  }
+
+  profile_close_func();
+
+  return result;
+}
+
+static
+f64 json_cursor_to_f64(JSON_Cursor cursor)
+{
+  f64 result = 0.0;
 
-    result *= sign;
+  if (json_cursor_valid(cursor))
+  {
+    result = string_to_f64(json_tape_string(cursor.tape, cursor.index));
   }
 
   return result;
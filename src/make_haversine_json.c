@@ -4,69 +4,370 @@
 
 #include <stdlib.h>
 
-#define WISH_ARG_COUNT 3 + 1
+#define DESIRED_POSITIONAL_COUNT 3
+
+// Every block of pairs (same blocks as the sum) gets its own random stream, so what comes out only
+// depends on the seed. Threads just decide who formats which blocks
+#define GENERATE_WAVE_BLOCKS   64  // Per thread, ~20 mb of text each before it gets written out
+#define GENERATE_MAX_PAIR_SIZE 96  // ',\n  {"x0":-180.000000, "y0":-90.000000, "x1":-180.000000, "y1":-90.000000}' is 79
+
+// Coordinates are whole millionths of a degree, exactly what %f would print. Dividing those out
+// gives the same f64 that parsing the text back gives, so the reference sum lines up bit for bit
+#define GENERATE_MICROS 1000000
+
+typedef enum Generate_Mode
+{
+  GENERATE_MODE_UNIFORM,
+  GENERATE_MODE_CLUSTER,
+} Generate_Mode;
+
+// xoshiro256**, https://prng.di.unimi.it/
+typedef struct Random_Series Random_Series;
+struct Random_Series
+{
+  u64 state[4];
+};
+
+static
+u64 splitmix64(u64 *state)
+{
+  *state += 0x9E3779B97F4A7C15ull;
+
+  u64 z = *state;
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+  return z ^ (z >> 31);
+}
+
+// Separate streams per (seed, stream), splitmix spreads them out so neighbouring streams are unrelated
+static
+Random_Series random_series_make(u64 seed, u64 stream)
+{
+  Random_Series result = {0};
+
+  u64 mix = seed ^ (stream * 0xD1B54A32D192ED03ull);
+  for (usize i = 0; i < STATIC_COUNT(result.state); i++)
+  {
+    result.state[i] = splitmix64(&mix);
+  }
+
+  return result;
+}
+
+static inline
+u64 rotate_left_u64(u64 x, u32 k)
+{
+  return (x << k) | (x >> (64 - k));
+}
+
+static inline
+u64 random_u64(Random_Series *series)
+{
+  u64 *s = series->state;
+
+  u64 result = rotate_left_u64(s[1] * 5, 7) * 9;
+  u64 t = s[1] << 17;
+
+  s[2] ^= s[0];
+  s[3] ^= s[1];
+  s[1] ^= s[2];
+  s[0] ^= s[3];
+
+  s[2] ^= t;
+  s[3] = rotate_left_u64(s[3], 45);
+
+  return result;
+}
+
+// Uniform in [min, max], both in millionths. Multiply-shift instead of modulo, bias is way below anything we'd notice
+static inline
+i64 random_micros(Random_Series *series, i64 min, i64 max)
+{
+  u64 range = (u64)(max - min) + 1;
+  u64 pick  = (u64)(((unsigned __int128)random_u64(series) * range) >> 64);
+
+  return min + (i64)pick;
+}
+
+// Same as printf("%f", micros / 1e6) but no locale, no varargs, and exact
+static inline
+usize format_micros(u8 *out, i64 micros)
+{
+  usize at = 0;
+
+  u64 magnitude = (u64)micros;
+  if (micros < 0)
+  {
+    out[at++] = '-';
+    magnitude = (u64)(-micros);
+  }
+
+  u64 whole = magnitude / GENERATE_MICROS;
+  u64 fraction = magnitude % GENERATE_MICROS;
+
+  u8 digits[20];
+  usize digit_count = 0;
+  do
+  {
+    digits[digit_count++] = '0' + (whole % 10);
+    whole /= 10;
+  } while (whole);
+
+  while (digit_count)
+  {
+    out[at++] = digits[--digit_count];
+  }
+
+  out[at++] = '.';
+  for (i32 i = 5; i >= 0; i--)
+  {
+    out[at + i] = '0' + (fraction % 10);
+    fraction /= 10;
+  }
+  at += 6;
+
+  return at;
+}
+
+static inline
+usize format_string(u8 *out, String string)
+{
+  MEM_COPY(out, string.v, string.count);
+  return string.count;
+}
+
+typedef struct Generate_Job Generate_Job;
+struct Generate_Job
+{
+  Generate_Mode mode;
+  u64           seed;
+  usize         pair_count;
+
+  // Range of blocks for this wave, text goes to the buffer and one sum per block
+  usize first_block;
+  usize block_count;
+  f64   *block_sums;
+
+  u8    *buffer;
+  usize buffer_used;
+
+  // Same pairs again for the binary file, from the wave's first pair
+  f64 *columns[4];
+};
+
+static
+void *generate_worker(void *params)
+{
+  Generate_Job *job = (Generate_Job *)params;
+
+  u8 *out = job->buffer;
+
+  for (usize block_idx = job->first_block; block_idx < job->first_block + job->block_count; block_idx++)
+  {
+    usize first = block_idx * HAVERSINE_SUM_BLOCK_PAIRS;
+    usize close = MIN(first + HAVERSINE_SUM_BLOCK_PAIRS, job->pair_count);
+
+    Random_Series series = random_series_make(job->seed, block_idx);
+
+    // Whole range, or for clusters a box per block around a random center each for point 0 and point 1
+    i64 min_x[2] = {-180 * GENERATE_MICROS, -180 * GENERATE_MICROS};
+    i64 max_x[2] = { 180 * GENERATE_MICROS,  180 * GENERATE_MICROS};
+    i64 min_y[2] = { -90 * GENERATE_MICROS,  -90 * GENERATE_MICROS};
+    i64 max_y[2] = {  90 * GENERATE_MICROS,   90 * GENERATE_MICROS};
+
+    if (job->mode == GENERATE_MODE_CLUSTER)
+    {
+      for (usize point = 0; point < 2; point++)
+      {
+        i64 radius   = random_micros(&series, 1 * GENERATE_MICROS, 30 * GENERATE_MICROS);
+        i64 center_x = random_micros(&series, min_x[point], max_x[point]);
+        i64 center_y = random_micros(&series, min_y[point], max_y[point]);
+
+        min_x[point] = MAX(center_x - radius, min_x[point]);
+        max_x[point] = MIN(center_x + radius, max_x[point]);
+        min_y[point] = MAX(center_y - radius, min_y[point]);
+        max_y[point] = MIN(center_y + radius, max_y[point]);
+      }
+    }
+
+    usize column_base = job->first_block * HAVERSINE_SUM_BLOCK_PAIRS;
+
+    f64 block_sum = 0.0;
+    for (usize i = first; i < close; i++)
+    {
+      i64 x0 = random_micros(&series, min_x[0], max_x[0]);
+      i64 y0 = random_micros(&series, min_y[0], max_y[0]);
+      i64 x1 = random_micros(&series, min_x[1], max_x[1]);
+      i64 y1 = random_micros(&series, min_y[1], max_y[1]);
+
+      // Only the very first pair gets no delimiter
+      out += format_string(out, i ? String(",\n  {\"x0\":") : String("  {\"x0\":"));
+      out += format_micros(out, x0);
+      out += format_string(out, String(", \"y0\":"));
+      out += format_micros(out, y0);
+      out += format_string(out, String(", \"x1\":"));
+      out += format_micros(out, x1);
+      out += format_string(out, String(", \"y1\":"));
+      out += format_micros(out, y1);
+      out += format_string(out, String("}"));
+
+      f64 pair[4] = {(f64)x0 / GENERATE_MICROS, (f64)y0 / GENERATE_MICROS, (f64)x1 / GENERATE_MICROS, (f64)y1 / GENERATE_MICROS};
+      for (usize column = 0; column < STATIC_COUNT(pair); column++)
+      {
+        job->columns[column][i - column_base] = pair[column];
+      }
+
+      block_sum += reference_haversine(pair[0], pair[1], pair[2], pair[3], HAVERSINE_EARTH_RADIUS);
+    }
+
+    job->block_sums[block_idx] = block_sum;
+  }
+
+  job->buffer_used = out - job->buffer;
+
+  return NULL;
+}
 
 int main(int arg_count, char **args)
 {
-  if (arg_count != WISH_ARG_COUNT)
+  Arena arena = arena_make(.reserve_size = GB(64));
+
+  Args arguments = parse_args(&arena, arg_count, args);
+  if (arguments.positionals_count != DESIRED_POSITIONAL_COUNT)
   {
-    printf("Usage: %s [uniform/cluster] [seed] [pair count]\n", args[0]);
+    printf("Usage: %s [uniform/cluster] [seed] [pair count] [--threads=N]\n", args[0]);
     return 1;
   }
 
-  FILE *json_file = fopen("haversine_pairs.json", "w");
+  Generate_Mode mode = GENERATE_MODE_UNIFORM;
+  if (string_match(arguments.positionals[0], String("cluster")))
+  {
+    mode = GENERATE_MODE_CLUSTER;
+  }
+  else if (!string_match(arguments.positionals[0], String("uniform")))
+  {
+    LOG_ERROR("Unknown mode '%.*s', expected uniform or cluster", String_Format(arguments.positionals[0]));
+    return 1;
+  }
+
+  u64   seed       = string_to_u64(arguments.positionals[1]);
+  usize pair_count = string_to_u64(arguments.positionals[2]);
+
+  usize thread_count = args_get_integer_value(&arguments, String("threads"), os_get_cpu_count());
+  thread_count = CLAMP(thread_count, 1, 256);
+
+  FILE *json_file = fopen("haversine_pairs.json", "wb");
   if (!json_file)
   {
     LOG_ERROR("Unable to open json file for writing.\n");
     return 1;
   }
 
-  u32 seed = atoi(args[2]);
-  srand(seed);
+  // Same pairs, no parsing needed, see Haversine_Pairs_Header
+  FILE *binary_file = fopen("haversine_pairs.bin", "wb");
+  if (!binary_file)
+  {
+    LOG_ERROR("Unable to open binary pairs file for writing.\n");
+    return 1;
+  }
+
+  Haversine_Pairs_Header header = haversine_pairs_header_make(pair_count);
 
-  i32 pair_count = atoi(args[3]);
+  // Placeholder header and padding up to the first column, the rest of the padding is just holes
+  u8 *placeholder = arena_calloc(&arena, header.column_offsets[0], u8);
+  fwrite(placeholder, 1, header.column_offsets[0], binary_file);
 
-  f64 *haversines = (f64 *)calloc(pair_count, sizeof(f64));
-  if (!haversines)
+  usize block_count = haversine_sum_block_count(pair_count);
+  f64 *block_sums = arena_calloc(&arena, block_count, f64);
+
+  Generate_Job jobs[256] = {0};
+
+  usize wave_pairs  = GENERATE_WAVE_BLOCKS * HAVERSINE_SUM_BLOCK_PAIRS;
+  usize buffer_size = wave_pairs * GENERATE_MAX_PAIR_SIZE;
+  for (usize thread_idx = 0; thread_idx < thread_count; thread_idx++)
   {
-    LOG_ERROR("Unable to allocate buffer for haversine values.\n");
-    return 1;
+    jobs[thread_idx].buffer = arena_calloc(&arena, buffer_size, u8);
+    for (usize column = 0; column < STATIC_COUNT(jobs[thread_idx].columns); column++)
+    {
+      jobs[thread_idx].columns[column] = arena_calloc(&arena, wave_pairs, f64);
+    }
   }
 
-  f64 haversine_sum = 0.0;
+  fputs("{\"pairs\" : [\n", json_file);
 
-  fprintf(json_file, "{\"pairs\" : [\n");
-  char delimiter[2] = ""; // Nothing to begin with
-  for (i32 i = 0; i < pair_count; i++)
+  // Each wave every thread formats a run of blocks into its own buffer, then they get written
+  // out in order. Keeps memory bounded no matter the pair count
+  for (usize wave_first = 0; wave_first < block_count; wave_first += thread_count * GENERATE_WAVE_BLOCKS)
   {
-    f64 inv_range_max = 1 / (f64)RAND_MAX;
+    OS_Thread threads[STATIC_COUNT(jobs)] = {0};
+
+    usize next_block = wave_first;
+    for (usize thread_idx = 0; thread_idx < thread_count; thread_idx++)
+    {
+      Generate_Job *job = jobs + thread_idx;
+      job->mode        = mode;
+      job->seed        = seed;
+      job->pair_count  = pair_count;
+      job->first_block = next_block;
+      job->block_count = MIN(GENERATE_WAVE_BLOCKS, block_count - next_block);
+      job->block_sums  = block_sums;
+      job->buffer_used = 0;
+
+      next_block += job->block_count;
+
+      // Main thread does the first job itself
+      if (thread_idx > 0)
+      {
+        threads[thread_idx] = os_thread_launch(generate_worker, job);
+      }
+    }
 
-    f64 x0 = ((f64)rand() * inv_range_max * 360) - 180;
-    f64 y0 = ((f64)rand() * inv_range_max * 180) - 90;
-    f64 x1 = ((f64)rand() * inv_range_max * 360) - 180;
-    f64 y1 = ((f64)rand() * inv_range_max * 180) - 90;
+    generate_worker(jobs + 0);
 
-    fprintf(json_file, "%s  ", delimiter);
-    delimiter[0] = ','; // After first it is a comma
-    delimiter[1] = '\n';
+    for (usize thread_idx = 1; thread_idx < thread_count; thread_idx++)
+    {
+      os_thread_join(threads[thread_idx]);
+    }
 
-    fprintf(json_file, "{\"x0\":%f, \"y0\":%f, \"x1\":%f, \"y1\":%f}", x0, y0, x1, y1);
+    for (usize thread_idx = 0; thread_idx < thread_count; thread_idx++)
+    {
+      Generate_Job *job = jobs + thread_idx;
 
-    // Do reference haversine
-    f64 earth_radius = 6372.8;
-    haversines[i] = reference_haversine(x0, y0, x1, y1, earth_radius);
-    haversine_sum += haversines[i];
+      fwrite(job->buffer, 1, job->buffer_used, json_file);
+
+      usize first_pair = job->first_block * HAVERSINE_SUM_BLOCK_PAIRS;
+      usize job_pairs  = MIN(job->block_count * HAVERSINE_SUM_BLOCK_PAIRS, pair_count - MIN(first_pair, pair_count));
+      for (usize column = 0; column < STATIC_COUNT(job->columns); column++)
+      {
+        header.column_checksums[column] = haversine_checksum_f64(header.column_checksums[column], job->columns[column], job_pairs);
+
+        fseek(binary_file, header.column_offsets[column] + first_pair * sizeof(f64), SEEK_SET);
+        fwrite(job->columns[column], sizeof(f64), job_pairs, binary_file);
+      }
+    }
   }
-  fprintf(json_file, "\n]}\n");
+
+  fputs("\n]}\n", json_file);
   fclose(json_file);
 
-  free(haversines);
+  // Same fixed order reduction as calc_haversine, so the sums can line up exactly
+  f64 haversine_sum = pairwise_sum_f64(block_sums, block_count);
+  if (pair_count)
+  {
+    haversine_sum /= pair_count;
+  }
 
-  haversine_sum /= pair_count;
+  // Real header now that the checksums and answer are known
+  header.expected_average = haversine_sum;
+  fseek(binary_file, 0, SEEK_SET);
+  fwrite(&header, sizeof(header), 1, binary_file);
+  fclose(binary_file);
 
   // Dump solution and pair count as binary
   FILE *solution_dump = fopen("solution_dump.data", "wb");
   fwrite(&haversine_sum, sizeof(haversine_sum), 1, solution_dump);
   fwrite(&pair_count, sizeof(pair_count), 1, solution_dump);
   fclose(solution_dump);
+
+  arena_free(&arena);
 }
@@ -0,0 +1,67 @@
+// Random pointer chains for dependent load tests, shared by reptest_latency and reptest_tlb_reach.
+// Link reptest_latency.asm for the kernel
+
+// Follows count pointers from start, returns where it ended up. count must be a multiple of 8
+extern u8 *pointer_chase_asm(u64 load_count, u8 *start);
+
+// Just has to be quick and not have any pattern the prefetchers could pick up on
+static
+u64 xorshift64(u64 *state)
+{
+  u64 x = *state;
+  x ^= x << 13;
+  x ^= x >> 7;
+  x ^= x << 17;
+  *state = x;
+
+  return x;
+}
+
+// Xorshift gets stuck on 0
+static
+u64 pointer_chain_seed(void)
+{
+  u64 result = 0;
+  os_get_random_bytes(&result, sizeof(result));
+
+  return result | 1;
+}
+
+static inline
+u64 *pointer_chain_slot(u8 *data, u64 i, u64 stride, u32 *offsets)
+{
+  return (u64 *)(data + i * stride + (offsets ? offsets[i] : 0));
+}
+
+// Slot i is at i * stride, plus offsets[i] if given. Sattolo's shuffle links them into a single
+// cycle in random order, so the chase can't end up stuck in a little loop that fits in cache and
+// the prefetchers can't guess where the next load is
+static
+u8 *build_pointer_chain(u8 *data, u64 count, u64 stride, u32 *offsets, u64 *random_state)
+{
+  for (u64 i = 0; i < count; i++)
+  {
+    *pointer_chain_slot(data, i, stride, offsets) = i;
+  }
+
+  for (u64 i = count - 1; i > 0; i--)
+  {
+    u64 j = xorshift64(random_state) % i;
+
+    u64 *a = pointer_chain_slot(data, i, stride, offsets);
+    u64 *b = pointer_chain_slot(data, j, stride, offsets);
+
+    u64 swap = *a;
+    *a = *b;
+    *b = swap;
+  }
+
+  // Indices to addresses
+  for (u64 i = 0; i < count; i++)
+  {
+    u64 *slot = pointer_chain_slot(data, i, stride, offsets);
+    *slot = (u64)pointer_chain_slot(data, *slot, stride, offsets);
+  }
+
+  return (u8 *)pointer_chain_slot(data, 0, stride, offsets);
+}
@@ -8,22 +8,433 @@
 extern void read_mask_asm(u64 count, u8 *data, u64 mask);
 extern void read_region_asm(u64 outer_count, u8 *data, u64 inner_count);
 
+// One per thread, each with its own region so threads only share what the cache hierarchy shares
+struct Operation_Parameters
+{
+  u8  *data;
+  u64 region_size;
+  u64 count;  // Bytes to read per test
+  b32 masked; // read_mask_asm like power-2, otherwise read_region_asm like granular
+};
+
+static
+void read_within_region(Repetition_Tester *tester, Operation_Parameters *params)
+{
+  u64 inner_size  = 512;
+  u64 inner_count = params->region_size / inner_size;
+  u64 outer_count = params->count / params->region_size;
+  u64 total_size  = params->masked ? params->count : outer_count * params->region_size;
+
+  while (repetition_tester_is_testing(tester))
+  {
+    repetition_tester_begin_time(tester);
+    if (params->masked)
+    {
+      read_mask_asm(params->count, params->data, params->region_size - 1);
+    }
+    else
+    {
+      read_region_asm(outer_count, params->data, inner_count);
+    }
+    repetition_tester_close_time(tester);
+
+    repetition_tester_count_bytes(tester, total_size);
+  }
+}
+
+// Same regions at 1, 2, 4... threads, to see where each level of the hierarchy stops scaling
+static
+void sweep_threads(usize max_threads, b32 masked, u64 cpu_timer_frequency, u32 seconds_to_try_for_min)
+{
+  // Past the last level cache by the end, without every thread needing a GB
+  u64 region_sizes[] = {KB(16), KB(256), MB(2), MB(16), MB(64)};
+
+  u64 max_region = region_sizes[STATIC_COUNT(region_sizes) - 1];
+
+  Operation_Parameters  params[REPTEST_MAX_THREADS] = {0};
+  Operation_Parameters *param_pointers[REPTEST_MAX_THREADS] = {0};
+  for (usize i = 0; i < max_threads; i++)
+  {
+    params[i].data    = os_allocate(max_region, OS_ALLOCATION_COMMIT|OS_ALLOCATION_PREFAULT);
+    param_pointers[i] = params + i;
+  }
+
+  usize thread_counts[32] = {0};
+  usize wave_count = 0;
+  for (usize threads = 1; threads < max_threads; threads *= 2)
+  {
+    thread_counts[wave_count++] = threads;
+  }
+  thread_counts[wave_count++] = max_threads;
+
+  f64 summed_gb_per_s[32][STATIC_COUNT(region_sizes)] = {0};
+  f64 wall_gb_per_s[32][STATIC_COUNT(region_sizes)]   = {0};
+
+  for (usize wave_idx = 0; wave_idx < wave_count; wave_idx++)
+  {
+    usize thread_count = thread_counts[wave_idx];
+
+    for (usize region_idx = 0; region_idx < STATIC_COUNT(region_sizes); region_idx++)
+    {
+      u64 region_size = region_sizes[region_idx];
+
+      // Split a GB of reads between threads, still at least one pass over the region each
+      u64 count = MAX(GB(1) / thread_count, region_size);
+      for (usize i = 0; i < thread_count; i++)
+      {
+        params[i].region_size = region_size;
+        params[i].count       = count;
+        params[i].masked      = masked;
+      }
+
+      printf("\n--- %lu threads reading %luMB each within %luKB regions ---\n", thread_count, count / MB(1), region_size / 1024);
+
+      Repetition_Tester testers[REPTEST_MAX_THREADS] = {0};
+
+      Repetition_Parallel_Wave wave =
+      {
+        .function                    = read_within_region,
+        .params                      = param_pointers,
+        .testers                     = testers,
+        .thread_count                = thread_count,
+        .target_processed_byte_count = count,
+        .cpu_timer_frequency         = cpu_timer_frequency,
+        .seconds_to_try_for_min      = seconds_to_try_for_min,
+      };
+
+      repetition_tester_parallel_wave(&wave);
+      print_repetition_parallel_wave(&wave);
+
+      summed_gb_per_s[wave_idx][region_idx] = repetition_parallel_wave_gb_per_s(&wave);
+      wall_gb_per_s[wave_idx][region_idx]   = repetition_parallel_wave_wall_gb_per_s(&wave);
+    }
+  }
+
+  printf("threads,region(kb),gb_per_s,wall_gb_per_s\n");
+  for (usize wave_idx = 0; wave_idx < wave_count; wave_idx++)
+  {
+    for (usize region_idx = 0; region_idx < STATIC_COUNT(region_sizes); region_idx++)
+    {
+      printf("%lu,%lu,%f,%f\n", thread_counts[wave_idx], region_sizes[region_idx] / 1024,
+             summed_gb_per_s[wave_idx][region_idx], wall_gb_per_s[wave_idx][region_idx]);
+    }
+  }
+
+  for (usize i = 0; i < max_threads; i++)
+  {
+    os_deallocate(params[i].data, max_region);
+  }
+}
+
+// Adaptive search, finds where bandwidth falls off a cliff instead of walking every size
+#define ADAPTIVE_MIN_REGION      KB(4)
+#define ADAPTIVE_MAX_REGION      MB(512)
+#define ADAPTIVE_MAX_SAMPLES     256
+#define ADAPTIVE_MAX_EDGES       16
+#define ADAPTIVE_EDGE_PRECISION  16 // Stop refining once the edge is known within 1/16th of its size
+#define DEFAULT_DROP_PERCENT     10 // Less of a drop than this between neighbors isn't a new level
+
+typedef struct Region_Sample Region_Sample;
+struct Region_Sample
+{
+  u64 region_size;
+  f64 gb_per_s;
+};
+
+typedef struct Cache_Edge Cache_Edge;
+struct Cache_Edge
+{
+  u64 region_size; // Biggest region still on the faster plateau
+  f64 gb_per_s;    // That plateau's bandwidth
+};
+
+static
+f64 measure_region(u8 *data, u64 count, u64 region_size, u64 cpu_timer_frequency, u32 seconds_to_try_for_min)
+{
+  u64 inner_size = 512;
+  u64 inner_count = region_size / inner_size;
+
+  u64 outer_count = count / region_size;
+  u64 total_size = outer_count * region_size;
+
+  printf("\n--- Reading %fMB within %luKB region ---\n", total_size/1024.0/1024.0, region_size/1024);
+
+  Repetition_Tester tester = {0};
+  repetition_tester_new_wave(&tester, total_size, cpu_timer_frequency, seconds_to_try_for_min);
+  while (repetition_tester_is_testing(&tester))
+  {
+    repetition_tester_begin_time(&tester);
+    read_region_asm(outer_count, data, inner_count);
+    repetition_tester_close_time(&tester);
+
+    repetition_tester_count_bytes(&tester, total_size);
+  }
+
+  Repetition_Test_Values min = tester.results.min;
+
+  f64 seconds = cpu_time_in_seconds(min.v[REPTEST_VALUE_TIME], cpu_timer_frequency);
+  return min.v[REPTEST_VALUE_BYTE_COUNT] / (f64)GB(1) / seconds;
+}
+
+static
+void insert_region_sample(Region_Sample *samples, usize *sample_count, Region_Sample sample)
+{
+  if (*sample_count >= ADAPTIVE_MAX_SAMPLES)
+  {
+    return;
+  }
+
+  usize at = *sample_count;
+  while (at > 0 && samples[at - 1].region_size > sample.region_size)
+  {
+    samples[at] = samples[at - 1];
+    at -= 1;
+  }
+  samples[at] = sample;
+
+  *sample_count += 1;
+}
+
+// Few enough to insertion sort a copy
+static
+f64 median_gb_per_s(Region_Sample *samples, usize sample_count)
+{
+  f64 sorted[ADAPTIVE_MAX_SAMPLES];
+  for (usize i = 0; i < sample_count; i++)
+  {
+    usize at = i;
+    while (at > 0 && sorted[at - 1] > samples[i].gb_per_s)
+    {
+      sorted[at] = sorted[at - 1];
+      at -= 1;
+    }
+    sorted[at] = samples[i].gb_per_s;
+  }
+
+  return sample_count ? sorted[sample_count / 2] : 0.0;
+}
+
+// Sysfs sizes look like "48K" or "2048K"
+static
+u64 read_sysfs_cache_value(usize index, const char *name, char *buffer, usize buffer_size)
+{
+  char path[256];
+  snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu0/cache/index%lu/%s", index, name);
+
+  u64 result = 0;
+
+  buffer[0] = '\0';
+
+  FILE *file = fopen(path, "r");
+  if (file)
+  {
+    if (fgets(buffer, (int)buffer_size, file))
+    {
+      char *end = NULL;
+      result = strtoull(buffer, &end, 10);
+
+      if      (*end == 'K') result *= KB(1);
+      else if (*end == 'M') result *= MB(1);
+      else if (*end == 'G') result *= GB(1);
+    }
+
+    fclose(file);
+  }
+
+  return result;
+}
+
+// What the kernel says the data caches are, next to whichever edge we found closest to each
+static
+void cross_check_sysfs(Cache_Edge *edges, usize edge_count)
+{
+  printf("\n--- Cross check against /sys/devices/system/cpu/cpu0/cache ---\n");
+
+  usize checked = 0;
+  for (usize index = 0; index < 16; index++)
+  {
+    char level_buffer[64];
+    char type_buffer[64];
+    char size_buffer[64];
+
+    u64 level = read_sysfs_cache_value(index, "level", level_buffer, sizeof(level_buffer));
+    read_sysfs_cache_value(index, "type", type_buffer, sizeof(type_buffer));
+    u64 size = read_sysfs_cache_value(index, "size", size_buffer, sizeof(size_buffer));
+
+    if (!level)
+    {
+      break;
+    }
+
+    // Only reading data here
+    if (strncmp(type_buffer, "Instruction", 11) == 0)
+    {
+      continue;
+    }
+
+    checked += 1;
+
+    Cache_Edge *closest = NULL;
+    for (usize i = 0; i < edge_count; i++)
+    {
+      if (!closest || fabs(log2((f64)edges[i].region_size / (f64)size)) < fabs(log2((f64)closest->region_size / (f64)size)))
+      {
+        closest = edges + i;
+      }
+    }
+
+    printf("L%lu %luKB: ", level, size / 1024);
+    if (closest)
+    {
+      f64 difference = 100.0 * ((f64)closest->region_size - (f64)size) / (f64)size;
+      printf("closest edge %luKB (%+.1f%%)", closest->region_size / 1024, difference);
+
+      // Shared caches, inclusive/exclusive policies and the other cores all move the edge some
+      if (fabs(log2((f64)closest->region_size / (f64)size)) > 1.0)
+      {
+        printf(", more than 2x off, likely a level that doesn't show in bandwidth or wasn't found");
+      }
+    }
+    else
+    {
+      printf("no edges found");
+    }
+    printf("\n");
+  }
+
+  if (!checked)
+  {
+    printf("Nothing in sysfs to check against\n");
+  }
+}
+
+// Power of 2 sizes first, then bisects between any neighbors where bandwidth drops by more than
+// drop_fraction to find the biggest size still on the faster plateau
+static
+void adaptive_search(u8 *data, u64 count, f64 drop_fraction, u64 cpu_timer_frequency, u32 seconds_to_try_for_min)
+{
+  Region_Sample samples[ADAPTIVE_MAX_SAMPLES] = {0};
+  usize sample_count = 0;
+
+  for (u64 region_size = ADAPTIVE_MIN_REGION; region_size <= MIN(ADAPTIVE_MAX_REGION, count); region_size *= 2)
+  {
+    Region_Sample sample = {region_size, measure_region(data, count, region_size, cpu_timer_frequency, seconds_to_try_for_min)};
+    insert_region_sample(samples, &sample_count, sample);
+  }
+
+  usize coarse_count = sample_count;
+
+  Region_Sample coarse[ADAPTIVE_MAX_SAMPLES] = {0};
+  MEM_COPY(coarse, samples, coarse_count * sizeof(Region_Sample));
+
+  Cache_Edge edges[ADAPTIVE_MAX_EDGES] = {0};
+  usize edge_count = 0;
+
+  // Compared against the median of the level so far, one lucky or unlucky sample doesn't make an edge
+  usize level_first = 0;
+  for (usize i = 0; i + 1 < coarse_count && edge_count < ADAPTIVE_MAX_EDGES; i++)
+  {
+    Region_Sample upper = coarse[i];
+    Region_Sample lower = coarse[i + 1];
+
+    f64 plateau = median_gb_per_s(coarse + level_first, i + 1 - level_first);
+    if (lower.gb_per_s >= plateau * (1.0 - drop_fraction))
+    {
+      continue;
+    }
+
+    // Region sizes stay multiples of the inner read size
+    u64 low  = upper.region_size;
+    u64 high = lower.region_size;
+    while ((high - low) * ADAPTIVE_EDGE_PRECISION > low && (high - low) > 512)
+    {
+      u64 middle = ((low + high) / 2) & ~(u64)511;
+      if (middle <= low)
+      {
+        break;
+      }
+
+      Region_Sample sample = {middle, measure_region(data, count, middle, cpu_timer_frequency, seconds_to_try_for_min)};
+      insert_region_sample(samples, &sample_count, sample);
+
+      if (sample.gb_per_s >= plateau * (1.0 - drop_fraction))
+      {
+        low = middle;
+      }
+      else
+      {
+        high = middle;
+      }
+    }
+
+    edges[edge_count++] = (Cache_Edge){.region_size = low, .gb_per_s = plateau};
+    level_first = i + 1;
+  }
+
+  printf("\n--- %lu waves, %lu coarse and %lu refining ---\n", sample_count, coarse_count, sample_count - coarse_count);
+
+  // A drop that spans a couple of coarse steps shows up as edges right next to each other
+  for (usize i = 0; i < edge_count; i++)
+  {
+    printf("Level %lu: up to %luKB, %.2f GB/s\n", i + 1, edges[i].region_size / 1024, edges[i].gb_per_s);
+  }
+  printf("Past the last edge: %.2f GB/s\n", median_gb_per_s(coarse + level_first, coarse_count - level_first));
+
+  cross_check_sysfs(edges, edge_count);
+
+  printf("region(kb),gb_per_s\n");
+  for (usize i = 0; i < sample_count; i++)
+  {
+    printf("%f,%f\n", samples[i].region_size / 1024.0, samples[i].gb_per_s);
+  }
+}
+
 int main(int arg_count, char **args)
 {
-  if (arg_count != 3)
+  Arena arena = arena_make();
+
+  Args arguments = parse_args(&arena, arg_count, args);
+
+  if (arguments.positionals_count != 2)
   {
-    printf("Usage: %s [seconds_to_try_for_min] [power-2/granular]\n", args[0]);
+    printf("Usage: %s [seconds_to_try_for_min] [power-2/granular/adaptive] [--threads=max_threads] [--confidence=percent]\n"
+           "                [--drop=percent]\n"
+           "  --confidence stops each region once its median is known within that percent, seconds_to_try_for_min\n"
+           "  becomes a cap\n"
+           "  adaptive only refines between sizes where bandwidth drops by more than --drop, default %d%%\n",
+           args[0], DEFAULT_DROP_PERCENT);
     return -1;
   }
 
-  u64 count = GB(1);
-  u8 *data = os_allocate(count, OS_ALLOCATION_COMMIT|OS_ALLOCATION_PREFAULT);
+  f64 confidence_percent = string_to_f64(args_get_string_value(&arguments, String("confidence"), String("0")));
+  repetition_tester_stop_on_confidence(confidence_percent / 100.0);
 
   u64 cpu_timer_frequency = estimate_cpu_timer_freq();
 
-  u32 seconds_to_try_for_min = atoi(args[1]);
+  u32 seconds_to_try_for_min = (u32)string_to_u64(arguments.positionals[0]);
 
-  if (strcmp(args[2], "power-2") == 0)
+  b32 power_2 = string_match(arguments.positionals[1], String("power-2"));
+
+  usize max_threads = args_get_integer_value(&arguments, String("threads"), 0);
+  if (max_threads)
+  {
+    max_threads = MIN(max_threads, REPTEST_MAX_THREADS);
+    sweep_threads(max_threads, power_2, cpu_timer_frequency, seconds_to_try_for_min);
+
+    arena_free(&arena);
+    return 0;
+  }
+
+  u64 count = GB(1);
+  u8 *data = os_allocate(count, OS_ALLOCATION_COMMIT|OS_ALLOCATION_PREFAULT);
+
+  if (string_match(arguments.positionals[1], String("adaptive")))
+  {
+    f64 drop_fraction = (f64)args_get_integer_value(&arguments, String("drop"), DEFAULT_DROP_PERCENT) / 100.0;
+
+    adaptive_search(data, count, drop_fraction, cpu_timer_frequency, seconds_to_try_for_min);
+  }
+  else if (power_2)
   {
     Repetition_Tester testers[30] = {0}; // 1 GB max 2^30 = 1G
 
@@ -69,9 +480,7 @@ int main(int arg_count, char **args)
     u64 region_sizes[96] = {0};
     Repetition_Tester testers[96] = {0};
 
-    // TODO: Would be cool to newton's method it, basically go until you see
-    // a big drop in throughput, backtrack more granularly until the difference
-    // is small again, should be more exact
+    // See adaptive for a search that only gets granular where it matters
     u64 delta_size = 512;
     u64 accum_size = KB(8);
     for (usize region_idx = 0; region_idx < STATIC_COUNT(testers); region_idx++)
@@ -121,4 +530,6 @@ int main(int arg_count, char **args)
   }
 
   os_deallocate(data, count);
+
+  arena_free(&arena);
 }
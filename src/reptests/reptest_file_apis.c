@@ -76,10 +76,64 @@ void read_with_read(Repetition_Tester *tester, Operation_Parameters *params)
   }
 }
 
+// Mapping itself is nearly free, the cost is faulting the pages in, so touch every page to make it fair
+static
+void read_with_mmap_flags(Repetition_Tester *tester, Operation_Parameters *params, File_Map_Flags flags)
+{
+  String name = string_from_c_string((char *)params->file_name);
+
+  while (repetition_tester_is_testing(tester))
+  {
+    repetition_tester_begin_time(tester);
+    String mapped = map_file_readonly(name, flags);
+
+    u64 touched = 0;
+    for (usize i = 0; i < mapped.count; i += KB(4))
+    {
+      touched += mapped.v[i];
+    }
+
+    unmap_file(mapped);
+    repetition_tester_close_time(tester);
+
+    volatile u64 sink = touched;
+
+    if (mapped.count == params->buffer.count)
+    {
+      repetition_tester_count_bytes(tester, params->buffer.count);
+    }
+    else
+    {
+      repetition_tester_error(tester, "Unable to map file");
+    }
+  }
+}
+
+static
+void read_with_mmap(Repetition_Tester *tester, Operation_Parameters *params)
+{
+  read_with_mmap_flags(tester, params, FILE_MAP_NONE);
+}
+
+static
+void read_with_mmap_sequential(Repetition_Tester *tester, Operation_Parameters *params)
+{
+  read_with_mmap_flags(tester, params, FILE_MAP_SEQUENTIAL);
+}
+
+static
+void read_with_mmap_populate(Repetition_Tester *tester, Operation_Parameters *params)
+{
+  read_with_mmap_flags(tester, params, FILE_MAP_PREFAULT);
+}
+
 Operation_Entry test_entries[] =
 {
-  {String("fread"), read_with_fread},
-  {String("read"),  read_with_read},
+  {String("fread"),           read_with_fread},
+  {String("read"),            read_with_read},
+  {String("mmap"),            read_with_mmap},
+  {String("mmap sequential"), read_with_mmap_sequential},
+  {String("mmap populate"),   read_with_mmap_populate},
 };
 
 int main(int arg_count, char **args)
@@ -0,0 +1,186 @@
+#define LOG_TITLE "REPETITION_TESTER"
+#define COMMON_IMPLEMENTATION
+#include "../common.h"
+
+#include "../benchmark/benchmark_inc.h"
+#include "../benchmark/benchmark_inc.c"
+
+typedef f64 Parse_Function(String string);
+
+// What string_to_f64 and json_object_to_f64 used to do, multiply-add per digit and pow() for exponents
+static
+f64 accumulate_to_f64(String string)
+{
+  f64 result = 0.0;
+
+  usize at = 0;
+
+  f64 sign = 1.0;
+  if (string.count > at && string.v[at] == '-')
+  {
+    sign = -1.0;
+    at += 1;
+  }
+
+  while (at < string.count && char_is_digit(string.v[at]))
+  {
+    result = 10 * result + (f64)(string.v[at] - '0');
+    at += 1;
+  }
+
+  if (at < string.count && string.v[at] == '.')
+  {
+    at += 1;
+
+    f64 factor = 1.0 / 10.0;
+    while (at < string.count && char_is_digit(string.v[at]))
+    {
+      result = result + factor * (f64)(string.v[at] - '0');
+      factor *= 1.0 / 10.0;
+      at += 1;
+    }
+  }
+
+  if (at < string.count && (string.v[at] == 'e' || string.v[at] == 'E'))
+  {
+    at += 1;
+
+    f64 e_sign = 1;
+    if (at < string.count && string.v[at] == '-')
+    {
+      e_sign = -1;
+      at += 1;
+    }
+
+    f64 exponent = 0.0;
+    while (at < string.count && char_is_digit(string.v[at]))
+    {
+      exponent = 10 * exponent + (f64)(string.v[at] - '0');
+      at += 1;
+    }
+
+    result *= pow(10.0, e_sign * exponent);
+  }
+
+  return sign * result;
+}
+
+// Numbers are all followed by a ',' in the buffer so strtod stops on its own, no copies
+static
+f64 strtod_to_f64(String string)
+{
+  return strtod((char *)string.v, NULL);
+}
+
+typedef struct Parse_Entry Parse_Entry;
+struct Parse_Entry
+{
+  String name;
+  Parse_Function *function;
+};
+
+Parse_Entry test_entries[] =
+{
+  {STR("strtod"),        strtod_to_f64},
+  {STR("accumulate"),    accumulate_to_f64},
+  {STR("string_to_f64"), string_to_f64},
+};
+
+static
+f64 random_f64(f64 min, f64 max)
+{
+  u64 random = 0;
+  os_get_random_bytes(&random, sizeof(random));
+
+  f64 t = (f64)(random >> 11) * (1.0 / (f64)(1L << 53));
+  return min + t * (max - min);
+}
+
+int main(int arg_count, char **args)
+{
+  if (arg_count != 2 && arg_count != 3)
+  {
+    printf("Usage: %s [seconds_to_try_for_min] [results_csv]\n", args[0]);
+    return -1;
+  }
+
+  u64 cpu_timer_frequency = estimate_cpu_timer_freq();
+
+  u32 seconds_to_try_for_min = atoi(args[1]);
+
+  // For benchmark_compare
+  if (arg_count == 3)
+  {
+    repetition_tester_record_results(string_from_c_string(args[2]));
+  }
+
+  Arena arena = arena_make();
+
+  // Same ranges and formatting as the uniform json generator
+  usize number_count = MB(1);
+  String *numbers = arena_calloc(&arena, number_count, String);
+  f64 *out = arena_calloc(&arena, number_count, f64);
+  f64 *expected = arena_calloc(&arena, number_count, f64);
+
+  usize buffer_size = number_count * 16;
+  u8 *buffer = arena_calloc(&arena, buffer_size, u8);
+  usize buffer_at = 0;
+  for (usize i = 0; i < number_count; i++)
+  {
+    f64 value = (i & 1) ? random_f64(-90.0, 90.0) : random_f64(-180.0, 180.0);
+
+    usize written = snprintf((char *)buffer + buffer_at, buffer_size - buffer_at, "%f,", value);
+    numbers[i] = (String){.v = buffer + buffer_at, .count = written - 1};
+    buffer_at += written;
+
+    expected[i] = strtod((char *)numbers[i].v, NULL);
+  }
+
+  u64 total_size = buffer_at;
+
+  Repetition_Tester testers[STATIC_COUNT(test_entries)] = {0};
+  usize mismatches[STATIC_COUNT(test_entries)] = {0};
+
+  for (usize func_idx = 0; func_idx < STATIC_COUNT(test_entries); func_idx++)
+  {
+    Parse_Entry *entry = test_entries + func_idx;
+
+    for (usize i = 0; i < number_count; i++)
+    {
+      f64 parsed = entry->function(numbers[i]);
+      mismatches[func_idx] += !MEM_MATCH(&parsed, expected + i, sizeof(f64));
+    }
+
+    Repetition_Tester *tester = testers + func_idx;
+    tester->name = entry->name;
+
+    printf("\n--- %.*s %lu numbers (%lu not correctly rounded) ---\n", STRF(entry->name), number_count, mismatches[func_idx]);
+
+    repetition_tester_new_wave(tester, total_size, cpu_timer_frequency, seconds_to_try_for_min);
+    while (repetition_tester_is_testing(tester))
+    {
+      repetition_tester_begin_time(tester);
+      for (usize i = 0; i < number_count; i++)
+      {
+        out[i] = entry->function(numbers[i]);
+      }
+      repetition_tester_close_time(tester);
+
+      repetition_tester_count_bytes(tester, total_size);
+    }
+  }
+
+  printf("parser,gb_per_s,cycles_per_number,mismatches\n");
+  for (usize func_idx = 0; func_idx < STATIC_COUNT(test_entries); func_idx++)
+  {
+    Repetition_Test_Values min = testers[func_idx].results.min;
+
+    f64 seconds = cpu_time_in_seconds(min.v[REPTEST_VALUE_TIME], cpu_timer_frequency);
+    f64 gb_per_s = min.v[REPTEST_VALUE_BYTE_COUNT] / (f64)GB(1) / seconds;
+    f64 cycles_per_number = (f64)min.v[REPTEST_VALUE_TIME] / (f64)number_count;
+
+    printf("%.*s,%.4f,%.2f,%lu\n", STRF(test_entries[func_idx].name), gb_per_s, cycles_per_number, mismatches[func_idx]);
+  }
+
+  arena_free(&arena);
+}
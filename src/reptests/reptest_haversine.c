@@ -0,0 +1,261 @@
+#define LOG_TITLE "REPETITION_TESTER"
+#define COMMON_IMPLEMENTATION
+#include "../common.h"
+
+#include "../benchmark/benchmark_inc.h"
+#include "../benchmark/benchmark_inc.c"
+
+#include "../haversine_impl.c"
+
+typedef struct Operation_Parameters Operation_Parameters;
+struct Operation_Parameters
+{
+  usize pair_count;
+  f64   *x0;
+  f64   *y0;
+  f64   *x1;
+  f64   *y1;
+  f64   *out;
+
+  Haversine_Batch_Function *batch;
+};
+
+static
+void reference_haversine_loop(const f64 *x0, const f64 *y0, const f64 *x1, const f64 *y1, usize count, f64 *out)
+{
+  for (usize i = 0; i < count; i++)
+  {
+    out[i] = reference_haversine(x0[i], y0[i], x1[i], y1[i], HAVERSINE_EARTH_RADIUS);
+  }
+}
+
+typedef struct Kernel_Entry Kernel_Entry;
+struct Kernel_Entry
+{
+  String name;
+  Haversine_Batch_Function *function;
+  b32 needs_avx2;
+  b32 needs_avx512;
+};
+
+Kernel_Entry test_entries[] =
+{
+  {STR("reference_haversine"), reference_haversine_loop, false, false},
+  {STR("batch scalar"),        haversine_batch_scalar,   false, false},
+  {STR("batch avx2"),          haversine_batch_avx2,     true,  false},
+  {STR("batch avx512"),        haversine_batch_avx512,   false, true},
+};
+
+// Whole sum pass (see calc_haversine), array of structs vs structure of arrays
+typedef struct Sum_Entry Sum_Entry;
+struct Sum_Entry
+{
+  String name;
+  b32 use_columns;
+  b32 use_batch;
+};
+
+Sum_Entry sum_entries[] =
+{
+  {STR("sum pairs (AoS) reference"),   false, false},
+  {STR("sum columns (SoA) reference"), true,  false},
+  {STR("sum pairs (AoS) batch"),       false, true},
+  {STR("sum columns (SoA) batch"),     true,  true},
+};
+
+static
+f64 sum_pass(Sum_Entry *entry, Haversine_Pair *pairs, Haversine_Pair_Columns *columns, f64 *block_sums)
+{
+  usize pair_count = columns->count;
+  usize block_count = haversine_sum_block_count(pair_count);
+
+  for (usize block_idx = 0; block_idx < block_count; block_idx++)
+  {
+    usize first = block_idx * HAVERSINE_SUM_BLOCK_PAIRS;
+    usize close = MIN(first + HAVERSINE_SUM_BLOCK_PAIRS, pair_count);
+
+    block_sums[block_idx] = entry->use_columns ?
+                            haversine_block_sum_columns(columns, first, close, entry->use_batch) :
+                            haversine_block_sum_pairs(pairs, first, close, entry->use_batch);
+  }
+
+  return pairwise_sum_f64(block_sums, block_count) / (f64)pair_count;
+}
+
+static
+f64 random_f64(f64 min, f64 max)
+{
+  u64 random = 0;
+  os_get_random_bytes(&random, sizeof(random));
+
+  f64 t = (f64)(random >> 11) * (1.0 / (f64)(1L << 53));
+  return min + t * (max - min);
+}
+
+int main(int arg_count, char **args)
+{
+  if (arg_count != 2 && arg_count != 3)
+  {
+    printf("Usage: %s [seconds_to_try_for_min] [results_csv]\n", args[0]);
+    return -1;
+  }
+
+  u64 cpu_timer_frequency = estimate_cpu_timer_freq();
+
+  u32 seconds_to_try_for_min = atoi(args[1]);
+
+  // For benchmark_compare
+  if (arg_count == 3)
+  {
+    repetition_tester_record_results(string_from_c_string(args[2]));
+  }
+
+  usize pair_count = MB(1);
+  usize column_size = pair_count * sizeof(f64);
+
+  f64 *x0 = os_allocate(column_size, OS_ALLOCATION_COMMIT|OS_ALLOCATION_PREFAULT);
+  f64 *y0 = os_allocate(column_size, OS_ALLOCATION_COMMIT|OS_ALLOCATION_PREFAULT);
+  f64 *x1 = os_allocate(column_size, OS_ALLOCATION_COMMIT|OS_ALLOCATION_PREFAULT);
+  f64 *y1 = os_allocate(column_size, OS_ALLOCATION_COMMIT|OS_ALLOCATION_PREFAULT);
+
+  f64 *reference = os_allocate(column_size, OS_ALLOCATION_COMMIT|OS_ALLOCATION_PREFAULT);
+  f64 *out       = os_allocate(column_size, OS_ALLOCATION_COMMIT|OS_ALLOCATION_PREFAULT);
+
+  // Same ranges as the uniform json generator
+  for (usize i = 0; i < pair_count; i++)
+  {
+    x0[i] = random_f64(-180.0, 180.0);
+    y0[i] = random_f64(-90.0,  90.0);
+    x1[i] = random_f64(-180.0, 180.0);
+    y1[i] = random_f64(-90.0,  90.0);
+  }
+
+  reference_haversine_loop(x0, y0, x1, y1, pair_count, reference);
+
+  // Reading all 4 columns and writing the output
+  u64 total_size = pair_count * 5 * sizeof(f64);
+
+  Repetition_Tester testers[STATIC_COUNT(test_entries)] = {0};
+  f64 max_errors[STATIC_COUNT(test_entries)] = {0};
+
+  for (usize func_idx = 0; func_idx < STATIC_COUNT(test_entries); func_idx++)
+  {
+    Kernel_Entry *entry = test_entries + func_idx;
+
+    if ((entry->needs_avx2 && !(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))) ||
+        (entry->needs_avx512 && !__builtin_cpu_supports("avx512f")))
+    {
+      printf("\n--- %.*s (not supported on this cpu, skipping) ---\n", STRF(entry->name));
+      continue;
+    }
+
+    entry->function(x0, y0, x1, y1, pair_count, out);
+
+    f64 max_error = 0.0;
+    for (usize i = 0; i < pair_count; i++)
+    {
+      max_error = MAX(max_error, fabs(out[i] - reference[i]));
+    }
+    max_errors[func_idx] = max_error;
+
+    if (max_error > HAVERSINE_BATCH_MAX_ERROR)
+    {
+      LOG_ERROR("%.*s max error %e is over the documented max of %e", STRF(entry->name), max_error, HAVERSINE_BATCH_MAX_ERROR);
+    }
+
+    Repetition_Tester *tester = testers + func_idx;
+    tester->name = entry->name;
+
+    printf("\n--- %.*s %lu pairs (max error %e) ---\n", STRF(entry->name), pair_count, max_error);
+
+    repetition_tester_new_wave(tester, total_size, cpu_timer_frequency, seconds_to_try_for_min);
+    while (repetition_tester_is_testing(tester))
+    {
+      repetition_tester_begin_time(tester);
+      entry->function(x0, y0, x1, y1, pair_count, out);
+      repetition_tester_close_time(tester);
+
+      repetition_tester_count_bytes(tester, total_size);
+    }
+  }
+
+  printf("kernel,gb_per_s,pairs_per_cycle,max_error\n");
+  for (usize func_idx = 0; func_idx < STATIC_COUNT(test_entries); func_idx++)
+  {
+    Repetition_Test_Values min = testers[func_idx].results.min;
+    if (!min.v[REPTEST_VALUE_BYTE_COUNT])
+    {
+      continue;
+    }
+
+    f64 seconds = cpu_time_in_seconds(min.v[REPTEST_VALUE_TIME], cpu_timer_frequency);
+    f64 gb_per_s = min.v[REPTEST_VALUE_BYTE_COUNT] / (f64)GB(1) / seconds;
+    f64 pairs_per_cycle = (f64)pair_count / (f64)min.v[REPTEST_VALUE_TIME];
+
+    printf("%.*s,%.4f,%.4f,%e\n", STRF(test_entries[func_idx].name), gb_per_s, pairs_per_cycle, max_errors[func_idx]);
+  }
+
+  // Now the whole sum pass over both layouts
+  usize pairs_size = pair_count * sizeof(Haversine_Pair);
+  Haversine_Pair *pairs = os_allocate(pairs_size, OS_ALLOCATION_COMMIT|OS_ALLOCATION_PREFAULT);
+  for (usize i = 0; i < pair_count; i++)
+  {
+    pairs[i] = (Haversine_Pair){x0[i], y0[i], x1[i], y1[i]};
+  }
+
+  Haversine_Pair_Columns columns =
+  {
+    .x0 = x0,
+    .y0 = y0,
+    .x1 = x1,
+    .y1 = y1,
+    .count    = pair_count,
+    .capacity = pair_count,
+  };
+
+  f64 *block_sums = os_allocate(haversine_sum_block_count(pair_count) * sizeof(f64), OS_ALLOCATION_COMMIT);
+
+  Repetition_Tester sum_testers[STATIC_COUNT(sum_entries)] = {0};
+
+  for (usize sum_idx = 0; sum_idx < STATIC_COUNT(sum_entries); sum_idx++)
+  {
+    Sum_Entry *entry = sum_entries + sum_idx;
+    Repetition_Tester *tester = sum_testers + sum_idx;
+    tester->name = entry->name;
+
+    printf("\n--- %.*s %lu pairs (%s) ---\n", STRF(entry->name), pair_count,
+           entry->use_batch ? haversine_batch_name(haversine_batch_select()) : "libm");
+
+    repetition_tester_new_wave(tester, pairs_size, cpu_timer_frequency, seconds_to_try_for_min);
+    while (repetition_tester_is_testing(tester))
+    {
+      repetition_tester_begin_time(tester);
+      volatile f64 sum = sum_pass(entry, pairs, &columns, block_sums);
+      repetition_tester_close_time(tester);
+
+      repetition_tester_count_bytes(tester, pairs_size);
+    }
+  }
+
+  printf("sum,gb_per_s,pairs_per_cycle\n");
+  for (usize sum_idx = 0; sum_idx < STATIC_COUNT(sum_entries); sum_idx++)
+  {
+    Repetition_Test_Values min = sum_testers[sum_idx].results.min;
+
+    f64 seconds = cpu_time_in_seconds(min.v[REPTEST_VALUE_TIME], cpu_timer_frequency);
+    f64 gb_per_s = min.v[REPTEST_VALUE_BYTE_COUNT] / (f64)GB(1) / seconds;
+    f64 pairs_per_cycle = (f64)pair_count / (f64)min.v[REPTEST_VALUE_TIME];
+
+    printf("%.*s,%.4f,%.4f\n", STRF(sum_entries[sum_idx].name), gb_per_s, pairs_per_cycle);
+  }
+
+  os_deallocate(pairs, pairs_size);
+  os_deallocate(block_sums, haversine_sum_block_count(pair_count) * sizeof(f64));
+
+  os_deallocate(x0, column_size);
+  os_deallocate(y0, column_size);
+  os_deallocate(x1, column_size);
+  os_deallocate(y1, column_size);
+  os_deallocate(reference, column_size);
+  os_deallocate(out, column_size);
+}
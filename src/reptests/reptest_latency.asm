@@ -0,0 +1,27 @@
+global pointer_chase_asm
+
+section .text
+
+; Follow a chain of pointers, each load needs the address from the one before
+; so nothing overlaps and the time per load is the latency
+
+; Linux calling convention. Load count in rdi (multiple of 8), chain start in rsi
+; Returns where the chain ended up, chase from there to keep going
+
+pointer_chase_asm:
+  align 64
+.loop:
+  mov rsi, [rsi]
+  mov rsi, [rsi]
+  mov rsi, [rsi]
+  mov rsi, [rsi]
+  mov rsi, [rsi]
+  mov rsi, [rsi]
+  mov rsi, [rsi]
+  mov rsi, [rsi]
+
+  sub rdi, 8
+  jnz .loop
+
+  mov rax, rsi
+  ret
@@ -0,0 +1,140 @@
+#define LOG_TITLE "REPETITION_TESTER"
+#define COMMON_IMPLEMENTATION
+#include "../common.h"
+
+#include "../benchmark/benchmark_inc.h"
+#include "../benchmark/benchmark_inc.c"
+
+#include "pointer_chain.c"
+
+#define CACHELINE_SIZE 64
+
+#define MIN_WORKING_SET KB(4)
+#define DEFAULT_MAX_MB  4096
+
+// Enough that the loop and timer overhead disappear, ~100ms per test once it's all from memory
+#define LOAD_COUNT MB(1)
+
+typedef struct Page_Entry Page_Entry;
+struct Page_Entry
+{
+  String              name;
+  OS_Allocation_Flags flags;
+  u64                 page_size;
+};
+
+Page_Entry page_entries[] =
+{
+  {STR("4kb_pages"), 0,                       KB(4)},
+  {STR("2mb_pages"), OS_ALLOCATION_2MB_PAGES, MB(2)},
+  {STR("1gb_pages"), OS_ALLOCATION_1GB_PAGES, GB(1)},
+};
+
+int main(int arg_count, char **args)
+{
+  Arena arena = arena_make();
+
+  Args arguments = parse_args(&arena, arg_count, args);
+
+  if (arguments.positionals_count != 1)
+  {
+    printf("Usage: %s [seconds_to_try_for_min] [--max-mb=working_set_mb] [--confidence=percent]\n"
+           "  Dependent loads through a random chain, 4kb to max-mb (default %d) working sets on each page size\n",
+           args[0], DEFAULT_MAX_MB);
+    return -1;
+  }
+
+  u64 cpu_timer_frequency = estimate_cpu_timer_freq();
+
+  u32 seconds_to_try_for_min = (u32)string_to_u64(arguments.positionals[0]);
+
+  u64 max_working_set = args_get_integer_value(&arguments, String("max-mb"), DEFAULT_MAX_MB) * MB(1);
+
+  f64 confidence_percent = string_to_f64(args_get_string_value(&arguments, String("confidence"), String("0")));
+  repetition_tester_stop_on_confidence(confidence_percent / 100.0);
+
+  usize working_set_count = 0;
+  for (u64 working_set = MIN_WORKING_SET; working_set <= max_working_set; working_set *= 2)
+  {
+    working_set_count += 1;
+  }
+
+  // 0 where that page size couldn't be had
+  f64 *ns_per_load = arena_calloc(&arena, working_set_count * STATIC_COUNT(page_entries), f64);
+
+  u64 random_state = pointer_chain_seed();
+
+  u64 total_size_processed = LOAD_COUNT * CACHELINE_SIZE;
+
+  for (usize page_idx = 0; page_idx < STATIC_COUNT(page_entries); page_idx++)
+  {
+    Page_Entry *entry = page_entries + page_idx;
+
+    usize working_set_idx = 0;
+    for (u64 working_set = MIN_WORKING_SET; working_set <= max_working_set; working_set *= 2, working_set_idx++)
+    {
+      // Own buffer per working set, so a few reserved huge pages still cover the small ones
+      u64 data_size = ALIGN_POW2_UP(working_set, entry->page_size);
+      u8 *data = os_allocate(data_size, OS_ALLOCATION_COMMIT|OS_ALLOCATION_PREFAULT|entry->flags);
+      if (!data)
+      {
+        // Bigger ones won't fit either
+        printf("\n--- %.*s: couldn't allocate %luMB, skipping from %luKB up (check /proc/sys/vm/nr_hugepages) ---\n",
+               STRF(entry->name), data_size / MB(1), working_set / 1024);
+        break;
+      }
+
+      u8 *start = build_pointer_chain(data, working_set / CACHELINE_SIZE, CACHELINE_SIZE, NULL, &random_state);
+
+      printf("\n--- %.*s chasing %lu loads within %luKB ---\n", STRF(entry->name), (u64)LOAD_COUNT, working_set / 1024);
+
+      Repetition_Tester tester = {0};
+      repetition_tester_new_wave(&tester, total_size_processed, cpu_timer_frequency, seconds_to_try_for_min);
+      while (repetition_tester_is_testing(&tester))
+      {
+        repetition_tester_begin_time(&tester);
+        start = pointer_chase_asm(LOAD_COUNT, start);
+        repetition_tester_close_time(&tester);
+
+        repetition_tester_count_bytes(&tester, total_size_processed);
+        repetition_tester_count_memops(&tester, LOAD_COUNT);
+      }
+
+      Repetition_Test_Values min = tester.results.min;
+
+      f64 seconds = cpu_time_in_seconds(min.v[REPTEST_VALUE_TIME], cpu_timer_frequency);
+      ns_per_load[working_set_idx * STATIC_COUNT(page_entries) + page_idx] = 1e9 * seconds / (f64)LOAD_COUNT;
+
+      os_deallocate(data, data_size);
+    }
+  }
+
+  // Dump csv
+  printf("working_set(kb)");
+  for (usize page_idx = 0; page_idx < STATIC_COUNT(page_entries); page_idx++)
+  {
+    printf(",%.*s_ns_per_load", STRF(page_entries[page_idx].name));
+  }
+  printf("\n");
+
+  u64 working_set = MIN_WORKING_SET;
+  for (usize working_set_idx = 0; working_set_idx < working_set_count; working_set_idx++, working_set *= 2)
+  {
+    printf("%lu", working_set / 1024);
+    for (usize page_idx = 0; page_idx < STATIC_COUNT(page_entries); page_idx++)
+    {
+      f64 ns = ns_per_load[working_set_idx * STATIC_COUNT(page_entries) + page_idx];
+      if (ns)
+      {
+        printf(",%.3f", ns);
+      }
+      else
+      {
+        printf(",");
+      }
+    }
+    printf("\n");
+  }
+
+  arena_free(&arena);
+}
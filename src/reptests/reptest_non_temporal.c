@@ -23,24 +23,154 @@ Assembly_Entry test_entries[] =
   {STR("read_non_temporal_asm"), read_non_temporal_asm},
 };
 
+struct Operation_Parameters
+{
+  Assembly_Entry *entry;
+  u8             *out;
+  u64            out_count;
+  u8             *in;
+  u64            in_count;
+};
+
+static
+void write_from_input(Repetition_Tester *tester, Operation_Parameters *params)
+{
+  while (repetition_tester_is_testing(tester))
+  {
+    repetition_tester_begin_time(tester);
+    params->entry->function(params->out, params->out_count, params->in, params->in_count);
+    repetition_tester_close_time(tester);
+
+    repetition_tester_count_bytes(tester, params->out_count);
+  }
+}
+
+// Same total output split between 1, 2, 4... threads, non-temporal stores may only pull ahead once
+// the threads together saturate the memory bus
+static
+void sweep_threads(usize max_threads, u64 in_count, u64 out_count, u64 cpu_timer_frequency, u32 seconds_to_try_for_min)
+{
+  usize thread_counts[32] = {0};
+  usize wave_count = 0;
+  for (usize threads = 1; threads < max_threads; threads *= 2)
+  {
+    thread_counts[wave_count++] = threads;
+  }
+  thread_counts[wave_count++] = max_threads;
+
+  Operation_Parameters  params[REPTEST_MAX_THREADS] = {0};
+  Operation_Parameters *param_pointers[REPTEST_MAX_THREADS] = {0};
+  u64                   out_sizes[REPTEST_MAX_THREADS] = {0};
+  for (usize i = 0; i < max_threads; i++)
+  {
+    // Only as much output as the smallest wave this thread is in writes
+    usize first_wave = 1;
+    while (first_wave < i + 1)
+    {
+      first_wave *= 2;
+    }
+    first_wave = MIN(first_wave, max_threads);
+    out_sizes[i] = MAX(out_count / first_wave / in_count, 1) * in_count;
+
+    params[i].in       = os_allocate(in_count, OS_ALLOCATION_COMMIT|OS_ALLOCATION_PREFAULT);
+    params[i].out      = os_allocate(out_sizes[i], OS_ALLOCATION_COMMIT|OS_ALLOCATION_PREFAULT);
+    params[i].in_count = in_count;
+    param_pointers[i]  = params + i;
+  }
+
+  f64 summed_gb_per_s[32][STATIC_COUNT(test_entries)] = {0};
+  f64 wall_gb_per_s[32][STATIC_COUNT(test_entries)]   = {0};
+
+  for (usize wave_idx = 0; wave_idx < wave_count; wave_idx++)
+  {
+    usize thread_count = thread_counts[wave_idx];
+
+    // Has to stay a multiple of the input size
+    u64 thread_out_count = MAX(out_count / thread_count / in_count, 1) * in_count;
+
+    for (usize func_idx = 0; func_idx < STATIC_COUNT(test_entries); func_idx++)
+    {
+      Assembly_Entry *entry = test_entries + func_idx;
+
+      for (usize i = 0; i < thread_count; i++)
+      {
+        params[i].entry     = entry;
+        params[i].out_count = thread_out_count;
+      }
+
+      printf("\n--- %.*s %lu threads reading in %lu bytes, writing to %lu bytes each ---\n",
+             STRF(entry->name), thread_count, in_count, thread_out_count);
+
+      Repetition_Tester testers[REPTEST_MAX_THREADS] = {0};
+
+      Repetition_Parallel_Wave wave =
+      {
+        .function                    = write_from_input,
+        .params                      = param_pointers,
+        .testers                     = testers,
+        .thread_count                = thread_count,
+        .target_processed_byte_count = thread_out_count,
+        .cpu_timer_frequency         = cpu_timer_frequency,
+        .seconds_to_try_for_min      = seconds_to_try_for_min,
+      };
+
+      repetition_tester_parallel_wave(&wave);
+      print_repetition_parallel_wave(&wave);
+
+      summed_gb_per_s[wave_idx][func_idx] = repetition_parallel_wave_gb_per_s(&wave);
+      wall_gb_per_s[wave_idx][func_idx]   = repetition_parallel_wave_wall_gb_per_s(&wave);
+    }
+  }
+
+  printf("threads,function,gb_per_s,wall_gb_per_s\n");
+  for (usize wave_idx = 0; wave_idx < wave_count; wave_idx++)
+  {
+    for (usize func_idx = 0; func_idx < STATIC_COUNT(test_entries); func_idx++)
+    {
+      printf("%lu,%.*s,%f,%f\n", thread_counts[wave_idx], STRF(test_entries[func_idx].name),
+             summed_gb_per_s[wave_idx][func_idx], wall_gb_per_s[wave_idx][func_idx]);
+    }
+  }
+
+  for (usize i = 0; i < max_threads; i++)
+  {
+    os_deallocate(params[i].in, in_count);
+    os_deallocate(params[i].out, out_sizes[i]);
+  }
+}
+
 int main(int arg_count, char **args)
 {
-  if (arg_count != 2)
+  Arena arena = arena_make();
+
+  Args arguments = parse_args(&arena, arg_count, args);
+
+  if (arguments.positionals_count != 1)
   {
-    printf("Usage: %s [seconds_to_try_for_min]\n", args[0]);
+    printf("Usage: %s [seconds_to_try_for_min] [--threads=max_threads]\n", args[0]);
     return -1;
   }
 
   u64 cpu_timer_frequency = estimate_cpu_timer_freq();
 
-  u32 seconds_to_try_for_min = atoi(args[1]);
+  u32 seconds_to_try_for_min = (u32)string_to_u64(arguments.positionals[0]);
 
   u64 cacheline_size = 64;
 
   u64 in_count = cacheline_size * 256;
-  u8 *in = os_allocate(in_count, OS_ALLOCATION_COMMIT|OS_ALLOCATION_PREFAULT);
-
   u64 out_count = in_count * 1024 * 64;
+
+  usize max_threads = args_get_integer_value(&arguments, String("threads"), 0);
+  if (max_threads)
+  {
+    max_threads = MIN(max_threads, REPTEST_MAX_THREADS);
+    sweep_threads(max_threads, in_count, out_count, cpu_timer_frequency, seconds_to_try_for_min);
+
+    arena_free(&arena);
+    return 0;
+  }
+
+  u8 *in = os_allocate(in_count, OS_ALLOCATION_COMMIT|OS_ALLOCATION_PREFAULT);
   u8 *out = os_allocate(out_count, OS_ALLOCATION_COMMIT|OS_ALLOCATION_PREFAULT);
 
   Repetition_Tester testers[STATIC_COUNT(test_entries)] = {0};
@@ -67,4 +197,6 @@ int main(int arg_count, char **args)
 
   os_deallocate(in, in_count);
   os_deallocate(out, out_count);
+
+  arena_free(&arena);
 }
@@ -0,0 +1,310 @@
+#define LOG_TITLE "REPETITION_TESTER"
+#define COMMON_IMPLEMENTATION
+#include "../common.h"
+
+#include "../benchmark/benchmark_inc.h"
+#include "../benchmark/benchmark_inc.c"
+
+#include "pointer_chain.c"
+
+#define CACHELINE_SIZE 64
+
+#define MAX_PAGES      KB(64) // Way past any STLB with 4KB pages
+#define MAX_SAMPLES    32     // Doubling from 1 to MAX_PAGES
+#define DEFAULT_MAX_MB 4096
+
+#define DEFAULT_RISE_PERCENT 20 // Less of a jump than this over the level so far isn't a new TLB level
+#define MAX_REACH_EDGES      4
+
+#define LOAD_COUNT MB(1)
+
+typedef struct Page_Entry Page_Entry;
+struct Page_Entry
+{
+  String              name;
+  OS_Allocation_Flags flags;
+  u64                 page_size;
+  u64                 min_pages;   // First level TLBs only hold a handful of 1GB pages
+  u32                 walk_levels; // Page table levels a miss has to walk, see address_anatomy.c
+};
+
+Page_Entry page_entries[] =
+{
+  {STR("4kb_pages"), 0,                       KB(4), 8, 4},
+  {STR("2mb_pages"), OS_ALLOCATION_2MB_PAGES, MB(2), 8, 3},
+  {STR("1gb_pages"), OS_ALLOCATION_1GB_PAGES, GB(1), 1, 2},
+};
+
+typedef struct Reach_Sample Reach_Sample;
+struct Reach_Sample
+{
+  u64 page_count;
+  f64 paged_ns;       // One line per page
+  f64 control_ns;     // Same lines with hardly any pages, see main()
+  f64 walks_per_load; // Negative without counters
+};
+
+// ns per load, and page walks per load if the counters are there
+static
+f64 measure_chain(u8 *start, u64 cpu_timer_frequency, u32 seconds_to_try_for_min, f64 *walks_per_load)
+{
+  u64 total_size_processed = LOAD_COUNT * CACHELINE_SIZE;
+
+  Repetition_Tester tester = {0};
+  repetition_tester_new_wave(&tester, total_size_processed, cpu_timer_frequency, seconds_to_try_for_min);
+  while (repetition_tester_is_testing(&tester))
+  {
+    repetition_tester_begin_time(&tester);
+    start = pointer_chase_asm(LOAD_COUNT, start);
+    repetition_tester_close_time(&tester);
+
+    repetition_tester_count_bytes(&tester, total_size_processed);
+    repetition_tester_count_memops(&tester, LOAD_COUNT);
+  }
+
+  Repetition_Test_Values min = tester.results.min;
+
+  if (walks_per_load)
+  {
+    b32 has_dtlb = tester.use_counters && (perf_counters_available() & (1 << PERF_COUNTER_DTLB_MISSES));
+    *walks_per_load = has_dtlb ? (f64)min.v[REPTEST_VALUE_DTLB_MISSES] / (f64)LOAD_COUNT : -1.0;
+  }
+
+  f64 seconds = cpu_time_in_seconds(min.v[REPTEST_VALUE_TIME], cpu_timer_frequency);
+  return 1e9 * seconds / (f64)LOAD_COUNT;
+}
+
+// Walks up the page counts and calls it a new level wherever paged / control jumps past the median
+// of the level so far, the control takes caches out of it
+static
+void print_reach(Page_Entry *entry, Reach_Sample *samples, usize sample_count, f64 rise_fraction)
+{
+  printf("%.*s (%u level walk):\n", STRF(entry->name), entry->walk_levels);
+
+  f64 ratios[MAX_SAMPLES] = {0};
+
+  usize level_first = 0;
+  usize edge_count  = 0;
+  for (usize i = 0; i < sample_count; i++)
+  {
+    ratios[i] = samples[i].control_ns > 0.0 ? samples[i].paged_ns / samples[i].control_ns : 0.0;
+
+    if (i == level_first)
+    {
+      continue;
+    }
+
+    // Median of the level so far, few enough to insertion sort a copy
+    f64 sorted[MAX_SAMPLES];
+    usize level_count = i - level_first;
+    for (usize j = 0; j < level_count; j++)
+    {
+      usize at = j;
+      while (at > 0 && sorted[at - 1] > ratios[level_first + j])
+      {
+        sorted[at] = sorted[at - 1];
+        at -= 1;
+      }
+      sorted[at] = ratios[level_first + j];
+    }
+    f64 level_ratio = sorted[level_count / 2];
+
+    if (ratios[i] > level_ratio * (1.0 + rise_fraction) && edge_count < MAX_REACH_EDGES)
+    {
+      Reach_Sample *inside  = samples + i - 1;
+      Reach_Sample *outside = samples + i;
+
+      f64 extra_ns = (outside->paged_ns - outside->control_ns) - (inside->paged_ns - inside->control_ns);
+
+      printf("  Reach %lu pages (%luKB), past it +%.2f ns per load", inside->page_count,
+             inside->page_count * entry->page_size / 1024, extra_ns);
+
+      // The generic dtlb miss event counts loads that needed a walk, a rise in time without more
+      // walks is falling out of the first level TLB into the second
+      if (outside->walks_per_load >= 0.0)
+      {
+        f64 extra_walks = outside->walks_per_load - inside->walks_per_load;
+        printf(", %.3f -> %.3f walks per load", inside->walks_per_load, outside->walks_per_load);
+
+        if (extra_walks > 0.1)
+        {
+          printf(" (page walks, ~%.2f ns each)", extra_ns / extra_walks);
+        }
+        else
+        {
+          printf(" (second level TLB hits)");
+        }
+      }
+      printf("\n");
+
+      edge_count += 1;
+      level_first = i;
+    }
+  }
+
+  if (!edge_count)
+  {
+    Reach_Sample *last = samples + sample_count - 1;
+    printf("  No drop up to %lu pages (%luMB), reach is at least that\n", last->page_count,
+           last->page_count * entry->page_size / MB(1));
+  }
+}
+
+int main(int arg_count, char **args)
+{
+  Arena arena = arena_make();
+
+  Args arguments = parse_args(&arena, arg_count, args);
+
+  if (arguments.positionals_count != 1)
+  {
+    printf("Usage: %s [seconds_to_try_for_min] [--max-mb=span_mb] [--rise=percent] [--confidence=percent]\n"
+           "  Dependent loads one per page over more and more pages on each page size, up to max-mb (default %d)\n"
+           "  of address space. A new TLB level is a jump of more than --rise (default %d%%) in time per load\n",
+           args[0], DEFAULT_MAX_MB, DEFAULT_RISE_PERCENT);
+    return -1;
+  }
+
+  u64 cpu_timer_frequency = estimate_cpu_timer_freq();
+
+  u32 seconds_to_try_for_min = (u32)string_to_u64(arguments.positionals[0]);
+
+  u64 max_span      = args_get_integer_value(&arguments, String("max-mb"), DEFAULT_MAX_MB) * MB(1);
+  f64 rise_fraction = (f64)args_get_integer_value(&arguments, String("rise"), DEFAULT_RISE_PERCENT) / 100.0;
+
+  f64 confidence_percent = string_to_f64(args_get_string_value(&arguments, String("confidence"), String("0")));
+  repetition_tester_stop_on_confidence(confidence_percent / 100.0);
+
+  u64 random_state = pointer_chain_seed();
+
+  // Packed control for every power of 2 line count, the same number of lines back to back so
+  // hardly any pages
+  u64 packed_size = MAX_PAGES * CACHELINE_SIZE;
+  u8 *packed = os_allocate(packed_size, OS_ALLOCATION_COMMIT|OS_ALLOCATION_PREFAULT);
+
+  f64 packed_ns[MAX_SAMPLES] = {0};
+  usize packed_idx = 0;
+  for (u64 line_count = 1; line_count <= MAX_PAGES; line_count *= 2, packed_idx++)
+  {
+    printf("\n--- packed %lu lines (%luKB) ---\n", line_count, line_count * CACHELINE_SIZE / 1024);
+
+    u8 *start = build_pointer_chain(packed, line_count, CACHELINE_SIZE, NULL, &random_state);
+    packed_ns[packed_idx] = measure_chain(start, cpu_timer_frequency, seconds_to_try_for_min, NULL);
+  }
+
+  os_deallocate(packed, packed_size);
+
+  // Where in its page each line goes. Random and independent of which page, otherwise the lines
+  // only ever land in a few cache sets and conflict misses get counted as TLB misses
+  u32 *offsets = arena_calloc(&arena, MAX_PAGES, u32);
+
+  Reach_Sample *samples = arena_calloc(&arena, STATIC_COUNT(page_entries) * MAX_SAMPLES, Reach_Sample);
+  usize sample_counts[STATIC_COUNT(page_entries)] = {0};
+
+  for (usize page_idx = 0; page_idx < STATIC_COUNT(page_entries); page_idx++)
+  {
+    Page_Entry *entry = page_entries + page_idx;
+
+    u64 max_pages = MIN(MAX_PAGES, max_span / entry->page_size);
+    if (max_pages < entry->min_pages)
+    {
+      printf("\n--- %.*s: fewer than %lu pages in %luMB, skipping (raise --max-mb) ---\n",
+             STRF(entry->name), entry->min_pages, max_span / MB(1));
+      continue;
+    }
+
+    Reach_Sample *page_samples = samples + page_idx * MAX_SAMPLES;
+
+    // Each page count gets its own allocation, so the smaller spans still run when huge pages are short
+    usize sample_idx = 0;
+    for (u64 page_count = entry->min_pages; page_count <= max_pages; page_count *= 2, sample_idx++)
+    {
+      u64 data_size = page_count * entry->page_size;
+      u8 *data = os_allocate(data_size, OS_ALLOCATION_COMMIT|OS_ALLOCATION_PREFAULT|entry->flags);
+      if (!data)
+      {
+        printf("\n--- %.*s: couldn't allocate %luMB, skipping from %lu pages up (check /proc/sys/vm/nr_hugepages) ---\n",
+               STRF(entry->name), data_size / MB(1), page_count);
+        break;
+      }
+
+      printf("\n--- %.*s one load per page over %lu pages (%luKB) ---\n", STRF(entry->name), page_count,
+             page_count * entry->page_size / 1024);
+
+      u64 lines_per_page = entry->page_size / CACHELINE_SIZE;
+      for (u64 i = 0; i < page_count; i++)
+      {
+        offsets[i] = (u32)((xorshift64(&random_state) % lines_per_page) * CACHELINE_SIZE);
+      }
+
+      u8 *start = build_pointer_chain(data, page_count, entry->page_size, offsets, &random_state);
+
+      Reach_Sample *sample = page_samples + sample_idx;
+      sample->page_count = page_count;
+      sample->paged_ns   = measure_chain(start, cpu_timer_frequency, seconds_to_try_for_min, &sample->walks_per_load);
+
+      os_deallocate(data, data_size);
+
+      // Better control for 4KB pages if we can get 2MB ones, the exact same layout so the same cache
+      // sets, but 512 times fewer pages
+      u64 huge_control_size = ALIGN_POW2_UP(data_size, MB(2));
+      u8 *huge_control = NULL;
+      if (entry->page_size == KB(4))
+      {
+        huge_control = os_allocate(huge_control_size, OS_ALLOCATION_COMMIT|OS_ALLOCATION_PREFAULT|OS_ALLOCATION_2MB_PAGES);
+      }
+
+      if (huge_control)
+      {
+        printf("\n--- control, same layout on 2MB pages ---\n");
+
+        u8 *control_start = build_pointer_chain(huge_control, page_count, entry->page_size, offsets, &random_state);
+        sample->control_ns = measure_chain(control_start, cpu_timer_frequency, seconds_to_try_for_min, NULL);
+
+        os_deallocate(huge_control, huge_control_size);
+      }
+      else
+      {
+        if (entry->page_size == KB(4))
+        {
+          printf("\n--- control, packed lines, no 2MB pages to be had ---\n");
+        }
+
+        // Powers of 2, the packed index is just which bit
+        sample->control_ns = packed_ns[__builtin_ctzll(page_count)];
+      }
+    }
+    sample_counts[page_idx] = sample_idx;
+  }
+
+  printf("\n--- Effective TLB reach ---\n");
+  for (usize page_idx = 0; page_idx < STATIC_COUNT(page_entries); page_idx++)
+  {
+    if (sample_counts[page_idx])
+    {
+      print_reach(page_entries + page_idx, samples + page_idx * MAX_SAMPLES, sample_counts[page_idx], rise_fraction);
+    }
+  }
+
+  // Dump csv
+  printf("page_size,pages,span(kb),ns_per_load,control_ns_per_load,tlb_ns_per_load,walks_per_load\n");
+  for (usize page_idx = 0; page_idx < STATIC_COUNT(page_entries); page_idx++)
+  {
+    Page_Entry *entry = page_entries + page_idx;
+    for (usize i = 0; i < sample_counts[page_idx]; i++)
+    {
+      Reach_Sample *sample = samples + page_idx * MAX_SAMPLES + i;
+
+      printf("%.*s,%lu,%lu,%.3f,%.3f,%.3f,", STRF(entry->name), sample->page_count,
+             sample->page_count * entry->page_size / 1024, sample->paged_ns, sample->control_ns,
+             sample->paged_ns - sample->control_ns);
+      if (sample->walks_per_load >= 0.0)
+      {
+        printf("%.4f", sample->walks_per_load);
+      }
+      printf("\n");
+    }
+  }
+
+  arena_free(&arena);
+}
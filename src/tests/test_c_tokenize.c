@@ -71,7 +71,7 @@ int main(int argc, char **argv)
         "`\n"
       );
 
-    C_Token_Array tokens = tokenize_c_code(&arena, sample_program);
+    C_Token_Array tokens = tokenize_c_code(&arena, sample_program).tokens;
     for EACH_INDEX(token_idx, tokens.count)
     {
       C_Token token = tokens.v[token_idx];
@@ -85,7 +85,7 @@ int main(int argc, char **argv)
   TEST_BLOCK(STR("Single character tokens"))
   {
 
-    C_Token_Array tokens = tokenize_c_code(&arena, STR("(){}[]"));
+    C_Token_Array tokens = tokenize_c_code(&arena, STR("(){}[]")).tokens;
     TEST_EVAL(tokens.count == 6);
     TEST_EVAL(tokens.v[0].type == C_TOKEN_BEGIN_PARENTHESIS);
     TEST_EVAL(tokens.v[1].type == C_TOKEN_CLOSE_PARENTHESIS);
@@ -99,7 +99,7 @@ int main(int argc, char **argv)
 
   TEST_BLOCK(STR("Single operators"))
   {
-    C_Token_Array tokens = tokenize_c_code(&arena, STR("+ - * / % = , ; ."));
+    C_Token_Array tokens = tokenize_c_code(&arena, STR("+ - * / % = , ; .")).tokens;
     TEST_EVAL(tokens.count == 9);
     TEST_EVAL(tokens.v[0].type == C_TOKEN_ADD);
     TEST_EVAL(tokens.v[1].type == C_TOKEN_MINUS);
@@ -116,7 +116,7 @@ int main(int argc, char **argv)
 
   TEST_BLOCK(STR("Double operators"))
   {
-    C_Token_Array tokens = tokenize_c_code(&arena, STR("++ -- == != <= >= && || ->"));
+    C_Token_Array tokens = tokenize_c_code(&arena, STR("++ -- == != <= >= && || ->")).tokens;
     TEST_EVAL(tokens.count == 9);
     TEST_EVAL(tokens.v[0].type == C_TOKEN_INCREMENT);
     TEST_EVAL(tokens.v[1].type == C_TOKEN_DECREMENT);
@@ -133,7 +133,7 @@ int main(int argc, char **argv)
 
   TEST_BLOCK(STR("Assignment operators"))
   {
-    C_Token_Array tokens = tokenize_c_code(&arena, STR("+= -= *= /= %= &= |= ^= <<= >>="));
+    C_Token_Array tokens = tokenize_c_code(&arena, STR("+= -= *= /= %= &= |= ^= <<= >>=")).tokens;
     TEST_EVAL(tokens.count == 10);
     TEST_EVAL(tokens.v[0].type == C_TOKEN_ADD_ASSIGN);
     TEST_EVAL(tokens.v[1].type == C_TOKEN_SUBTRACT_ASSIGN);
@@ -151,7 +151,7 @@ int main(int argc, char **argv)
 
   TEST_BLOCK(STR("Bitwise operators"))
   {
-    C_Token_Array tokens = tokenize_c_code(&arena, STR("& | ^ ~ < >"));
+    C_Token_Array tokens = tokenize_c_code(&arena, STR("& | ^ ~ < >")).tokens;
     TEST_EVAL(tokens.count == 6);
     TEST_EVAL(tokens.v[0].type == C_TOKEN_BITWISE_AND);
     TEST_EVAL(tokens.v[1].type == C_TOKEN_BITWISE_OR);
@@ -165,7 +165,7 @@ int main(int argc, char **argv)
 
   TEST_BLOCK(STR("Bitwise operators"))
   {
-    C_Token_Array tokens = tokenize_c_code(&arena, STR("& | ^ ~ < >"));
+    C_Token_Array tokens = tokenize_c_code(&arena, STR("& | ^ ~ < >")).tokens;
     TEST_EVAL(tokens.count == 6);
     TEST_EVAL(tokens.v[0].type == C_TOKEN_BITWISE_AND);
     TEST_EVAL(tokens.v[1].type == C_TOKEN_BITWISE_OR);
@@ -179,7 +179,7 @@ int main(int argc, char **argv)
 
   TEST_BLOCK(STR("Control flow keywords"))
   {
-    C_Token_Array tokens = tokenize_c_code(&arena, STR("if else for while do switch case default break continue return goto"));
+    C_Token_Array tokens = tokenize_c_code(&arena, STR("if else for while do switch case default break continue return goto")).tokens;
     TEST_EVAL(tokens.count == 12);
     TEST_EVAL(tokens.v[0].type == C_TOKEN_KEYWORD_IF);
     TEST_EVAL(tokens.v[1].type == C_TOKEN_KEYWORD_ELSE);
@@ -199,7 +199,7 @@ int main(int argc, char **argv)
 
   TEST_BLOCK(STR("Type keywords"))
   {
-    C_Token_Array tokens = tokenize_c_code(&arena, STR("void char short int long float double unsigned signed"));
+    C_Token_Array tokens = tokenize_c_code(&arena, STR("void char short int long float double unsigned signed")).tokens;
     TEST_EVAL(tokens.count == 9);
     TEST_EVAL(tokens.v[0].type == C_TOKEN_KEYWORD_VOID);
     TEST_EVAL(tokens.v[1].type == C_TOKEN_KEYWORD_CHAR);
@@ -216,7 +216,7 @@ int main(int argc, char **argv)
 
   TEST_BLOCK(STR("Declaration keywords"))
   {
-    C_Token_Array tokens = tokenize_c_code(&arena, STR("struct enum union typedef const static extern inline register restrict sizeof"));
+    C_Token_Array tokens = tokenize_c_code(&arena, STR("struct enum union typedef const static extern inline register restrict sizeof")).tokens;
     TEST_EVAL(tokens.count == 11);
     TEST_EVAL(tokens.v[0].type == C_TOKEN_KEYWORD_STRUCT);
     TEST_EVAL(tokens.v[1].type == C_TOKEN_KEYWORD_ENUM);
@@ -235,7 +235,7 @@ int main(int argc, char **argv)
 
   TEST_BLOCK(STR("Identifiers"))
   {
-    C_Token_Array tokens = tokenize_c_code(&arena, STR("foo bar _test var123 _123 intensity floating"));
+    C_Token_Array tokens = tokenize_c_code(&arena, STR("foo bar _test var123 _123 intensity floating")).tokens;
     TEST_EVAL(tokens.count == 7);
     TEST_EVAL(tokens.v[0].type == C_TOKEN_IDENTIFIER);
     TEST_EVAL(tokens.v[1].type == C_TOKEN_IDENTIFIER);
@@ -255,7 +255,7 @@ int main(int argc, char **argv)
 
   TEST_BLOCK(STR("Integer literals"))
   {
-    C_Token_Array tokens = tokenize_c_code(&arena, STR("42 123u 456L 789LL 999uL 111uLL"));
+    C_Token_Array tokens = tokenize_c_code(&arena, STR("42 123u 456L 789LL 999uL 111uLL")).tokens;
     TEST_EVAL(tokens.count == 6);
     TEST_EVAL(tokens.v[0].type == C_TOKEN_LITERAL);
     TEST_EVAL(tokens.v[1].type == C_TOKEN_LITERAL);
@@ -288,7 +288,7 @@ int main(int argc, char **argv)
 
   TEST_BLOCK(STR("Float literals"))
   {
-    C_Token_Array tokens = tokenize_c_code(&arena, STR("3.14 2.5f 1.0e10 7.0e 6.022E-23 8e1 4.0L"));
+    C_Token_Array tokens = tokenize_c_code(&arena, STR("3.14 2.5f 1.0e10 7.0e 6.022E-23 8e1 4.0L")).tokens;
     TEST_EVAL(tokens.count == 6);
     TEST_EVAL(tokens.v[0].type == C_TOKEN_LITERAL);
     TEST_EVAL(tokens.v[1].type == C_TOKEN_LITERAL);
@@ -318,7 +318,7 @@ int main(int argc, char **argv)
   {
     C_Token_Array tokens = tokenize_c_code(&arena, STR("\"hello\" \"world\""
                                                        "\"invalid\n \"test\\nstring\""
-                                                       "\"hello\\x10\" \"quote\\\"\""));
+                                                       "\"hello\\x10\" \"quote\\\"\"")).tokens;
     TEST_EVAL(tokens.count == 5);
     TEST_EVAL(tokens.v[0].type == C_TOKEN_LITERAL);
     TEST_EVAL(tokens.v[1].type == C_TOKEN_LITERAL);
@@ -341,7 +341,7 @@ int main(int argc, char **argv)
 
   TEST_BLOCK(STR("Character literals"))
   {
-    C_Token_Array tokens = tokenize_c_code(&arena, STR("'a' 'b' '\\n' '\\t' '\\\\' "));
+    C_Token_Array tokens = tokenize_c_code(&arena, STR("'a' 'b' '\\n' '\\t' '\\\\' ")).tokens;
     TEST_EVAL(tokens.count == 5);
     TEST_EVAL(tokens.v[0].type == C_TOKEN_LITERAL);
     TEST_EVAL(tokens.v[1].type == C_TOKEN_LITERAL);
@@ -363,7 +363,7 @@ int main(int argc, char **argv)
 
   TEST_BLOCK(STR("Character literals - raw byte escapes"))
   {
-    C_Token_Array tokens = tokenize_c_code(&arena, STR("'\\x01' '\\0' '\\77'"));
+    C_Token_Array tokens = tokenize_c_code(&arena, STR("'\\x01' '\\0' '\\77'")).tokens;
     TEST_EVAL(tokens.count == 3);
     TEST_EVAL(tokens.v[0].type == C_TOKEN_LITERAL);
     TEST_EVAL(tokens.v[1].type == C_TOKEN_LITERAL);
@@ -378,7 +378,7 @@ int main(int argc, char **argv)
 
   TEST_BLOCK(STR("Single-line comments"))
   {
-    C_Token_Array tokens = tokenize_c_code(&arena, STR("foo // this is a comment\nbar"));
+    C_Token_Array tokens = tokenize_c_code(&arena, STR("foo // this is a comment\nbar")).tokens;
     TEST_EVAL(tokens.count == 2);
     TEST_EVAL(tokens.v[0].type == C_TOKEN_IDENTIFIER);
     TEST_EVAL(tokens.v[1].type == C_TOKEN_IDENTIFIER);
@@ -390,7 +390,7 @@ int main(int argc, char **argv)
 
   TEST_BLOCK(STR("Multi-line comments"))
   {
-    C_Token_Array tokens = tokenize_c_code(&arena, STR("foo /* this is a\nmulti-line comment */ bar"));
+    C_Token_Array tokens = tokenize_c_code(&arena, STR("foo /* this is a\nmulti-line comment */ bar")).tokens;
     TEST_EVAL(tokens.count == 2);
     TEST_EVAL(tokens.v[0].type == C_TOKEN_IDENTIFIER);
     TEST_EVAL(tokens.v[1].type == C_TOKEN_IDENTIFIER);
@@ -402,7 +402,7 @@ int main(int argc, char **argv)
 
   TEST_BLOCK(STR("Simple expression"))
   {
-    C_Token_Array tokens = tokenize_c_code(&arena, STR("x = y + 5;"));
+    C_Token_Array tokens = tokenize_c_code(&arena, STR("x = y + 5;")).tokens;
     TEST_EVAL(tokens.count == 6);
     TEST_EVAL(tokens.v[0].type == C_TOKEN_IDENTIFIER);
     TEST_EVAL(tokens.v[1].type == C_TOKEN_ASSIGN);
@@ -416,7 +416,7 @@ int main(int argc, char **argv)
 
   TEST_BLOCK(STR("Simple expression"))
   {
-    C_Token_Array tokens = tokenize_c_code(&arena, STR("x = y + 5;"));
+    C_Token_Array tokens = tokenize_c_code(&arena, STR("x = y + 5;")).tokens;
     TEST_EVAL(tokens.count == 6);
     TEST_EVAL(tokens.v[0].type == C_TOKEN_IDENTIFIER);
     TEST_EVAL(tokens.v[1].type == C_TOKEN_ASSIGN);
@@ -430,7 +430,7 @@ int main(int argc, char **argv)
 
   TEST_BLOCK(STR("Function declaration"))
   {
-    C_Token_Array tokens = tokenize_c_code(&arena, STR("int foo(int x, int y)"));
+    C_Token_Array tokens = tokenize_c_code(&arena, STR("int foo(int x, int y)")).tokens;
     TEST_EVAL(tokens.count == 9);
     TEST_EVAL(tokens.v[0].type == C_TOKEN_KEYWORD_INT);
     TEST_EVAL(tokens.v[1].type == C_TOKEN_IDENTIFIER);
@@ -447,7 +447,7 @@ int main(int argc, char **argv)
 
   TEST_BLOCK(STR("Struct member access"))
   {
-    C_Token_Array tokens = tokenize_c_code(&arena, STR("foo.bar ptr->baz"));
+    C_Token_Array tokens = tokenize_c_code(&arena, STR("foo.bar ptr->baz")).tokens;
     TEST_EVAL(tokens.count == 6);
     TEST_EVAL(tokens.v[0].type == C_TOKEN_IDENTIFIER);
     TEST_EVAL(tokens.v[1].type == C_TOKEN_DOT);
@@ -461,7 +461,7 @@ int main(int argc, char **argv)
 
   TEST_BLOCK(STR("Pointer operations"))
   {
-    C_Token_Array tokens = tokenize_c_code(&arena, STR("*ptr &value **double_ptr"));
+    C_Token_Array tokens = tokenize_c_code(&arena, STR("*ptr &value **double_ptr")).tokens;
     TEST_EVAL(tokens.count == 7);
     TEST_EVAL(tokens.v[0].type == C_TOKEN_STAR);
     TEST_EVAL(tokens.v[1].type == C_TOKEN_IDENTIFIER);
@@ -476,7 +476,7 @@ int main(int argc, char **argv)
 
   TEST_BLOCK(STR("Array indexing"))
   {
-    C_Token_Array tokens = tokenize_c_code(&arena, STR("array[0] matrix[i][j]"));
+    C_Token_Array tokens = tokenize_c_code(&arena, STR("array[0] matrix[i][j]")).tokens;
     TEST_EVAL(tokens.count == 11);
     TEST_EVAL(tokens.v[0].type == C_TOKEN_IDENTIFIER);
     TEST_EVAL(tokens.v[1].type == C_TOKEN_BEGIN_SQUARE_BRACE);
@@ -495,7 +495,7 @@ int main(int argc, char **argv)
 
   TEST_BLOCK(STR("Whitespace handling"))
   {
-    C_Token_Array tokens = tokenize_c_code(&arena, STR("  \n\t  foo   \n  bar  \t\n"));
+    C_Token_Array tokens = tokenize_c_code(&arena, STR("  \n\t  foo   \n  bar  \t\n")).tokens;
     TEST_EVAL(tokens.count == 2);
     TEST_EVAL(tokens.v[0].type == C_TOKEN_IDENTIFIER);
     TEST_EVAL(tokens.v[1].type == C_TOKEN_IDENTIFIER);
@@ -507,7 +507,7 @@ int main(int argc, char **argv)
 
   TEST_BLOCK(STR("Ternary expression"))
   {
-    C_Token_Array tokens = tokenize_c_code(&arena, STR("x = x > y ? x : y;"));
+    C_Token_Array tokens = tokenize_c_code(&arena, STR("x = x > y ? x : y;")).tokens;
     TEST_EVAL(tokens.count == 10);
     TEST_EVAL(tokens.v[0].type == C_TOKEN_IDENTIFIER);
     TEST_EVAL(tokens.v[1].type == C_TOKEN_ASSIGN);
@@ -525,7 +525,7 @@ int main(int argc, char **argv)
 
   TEST_BLOCK(STR("Different base integer literals"))
   {
-    C_Token_Array tokens = tokenize_c_code(&arena, STR("0x42 0b 0x 0x12L 0b11u 0b10 0xFA"));
+    C_Token_Array tokens = tokenize_c_code(&arena, STR("0x42 0b 0x 0x12L 0b11u 0b10 0xFA")).tokens;
     TEST_EVAL(tokens.count == 5);
     TEST_EVAL(tokens.v[0].type == C_TOKEN_LITERAL);
     TEST_EVAL(tokens.v[1].type == C_TOKEN_LITERAL);
@@ -546,6 +546,42 @@ int main(int argc, char **argv)
     arena_clear(&arena);
   }
 
+  TEST_BLOCK(STR("Tokenize mapped file"))
+  {
+    // Tokenizing this very file through the mapping should match tokenizing a copy of it
+    String file_name = STR(__FILE__);
+    String copied = read_file_to_arena(&arena, file_name);
+    C_Tokenize_Result from_copy = tokenize_c_code(&arena, copied);
+    C_Tokenize_Result from_file = tokenize_c_file(&arena, file_name);
+
+    TEST_EVAL(!from_file.had_error);
+    TEST_EVAL(from_file.source.count == copied.count);
+    TEST_EVAL(from_file.tokens.count == from_copy.tokens.count);
+    TEST_EVAL(from_file.tokens.count > 0);
+
+    b32 all_match = from_file.tokens.count == from_copy.tokens.count;
+    for (usize i = 0; all_match && i < from_file.tokens.count; i++)
+    {
+      C_Token file_token = from_file.tokens.v[i];
+      C_Token copy_token = from_copy.tokens.v[i];
+      all_match = file_token.type == copy_token.type &&
+                  string_match(file_token.raw, copy_token.raw);
+    }
+    TEST_EVAL(all_match);
+
+    // Tokens point into the mapping itself
+    C_Token last = from_file.tokens.v[from_file.tokens.count - 1];
+    TEST_EVAL(last.raw.v >= from_file.source.v &&
+              last.raw.v + last.raw.count <= from_file.source.v + from_file.source.count);
+
+    unmap_file(from_file.source);
+
+    C_Tokenize_Result missing = tokenize_c_file(&arena, STR("this/file/does/not/exist.c"));
+    TEST_EVAL(missing.had_error);
+
+    arena_clear(&arena);
+  }
+
   tester_summarize();
 
   arena_free(&arena);
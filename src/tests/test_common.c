@@ -457,6 +457,30 @@ int main(int argc, char **argv)
     TEST_EVAL(string_match(test, form));
   }
 
+  TEST_BLOCK(STR("string_to_f64"))
+  {
+    // Should round exactly like the C library does
+    const char *numbers[] =
+    {
+      "0", "-0", "1", "-1", "0.1", "0.3", "123.456", "-99.677494", "163.454781",
+      "1e23", "8.98846567431158e307", "1.7976931348623157e308", "1e309", "2.2250738585072014e-308",
+      "9007199254740993", "9007199254740992.5", "0.000000000000000000000000000123",
+      "3.14159265358979323846264338327950288", "1.00000000000000011102230246251565404236316680908203125",
+      "4.9e-324", "1e-400", "2.5E-3", "7e+2", "1234567890123456789012345678901234567890",
+    };
+
+    for (usize i = 0; i < STATIC_COUNT(numbers); i++)
+    {
+      f64 expected = strtod(numbers[i], NULL);
+      f64 parsed   = string_to_f64(string_from_c_string((char *)numbers[i]));
+      TEST_EVAL(MEM_MATCH(&expected, &parsed, sizeof(f64)));
+    }
+
+    // Stops at the end of the number
+    TEST_EVAL(string_to_f64(String("12.5, \"y0\"")) == 12.5);
+    TEST_EVAL(string_to_f64(String("3e")) == 3.0);
+  }
+
   tester_summarize();
 
   arena_free(&arena);
@@ -0,0 +1,633 @@
+#define COMMON_IMPLEMENTATION
+#include "../common.h"
+
+#include "testing.h"
+#include "testing.c"
+
+#include "../benchmark/platform_timing.c"
+#include "../benchmark/latency_histogram.c"
+#include "../benchmark/benchmark_results.c"
+#include "../benchmark/profile.c"
+#include "../json_parse.c"
+
+#define TEST_JSON_BUFFER_SIZE (JSON_SCAN_BLOCK_BYTES * 3)
+
+// One byte at a time, a byte is escaped if the byte before it is a backslash that is not escaped itself
+static
+void escaped_reference(const u8 *bytes, usize count, b8 *escaped)
+{
+  b32 escape_next = false;
+  for EACH_INDEX(i, count)
+  {
+    escaped[i] = escape_next;
+    if (escape_next)
+    {
+      escape_next = false;
+    }
+    else if (bytes[i] == '\\')
+    {
+      escape_next = true;
+    }
+  }
+}
+
+// Feeds the buffer block by block through json_find_escaped, carrying state across, and checks every bit
+static
+b32 escaped_blocks_match(const u8 *bytes, usize count)
+{
+  b8 reference[TEST_JSON_BUFFER_SIZE] = {0};
+  escaped_reference(bytes, count, reference);
+
+  b32 result = true;
+  u64 prev_escaped = 0;
+  for (usize base = 0; base < count; base += JSON_SCAN_BLOCK_BYTES)
+  {
+    JSON_Block_Masks masks = json_classify_block_scalar(bytes + base);
+    u64 escaped = json_find_escaped(masks.backslash, &prev_escaped);
+
+    for EACH_INDEX(bit, JSON_SCAN_BLOCK_BYTES)
+    {
+      b32 got = (escaped >> bit) & 1;
+      result &= got == reference[base + bit];
+    }
+  }
+
+  return result;
+}
+
+// The scanner tokenizer jumps between positions from the bit masks, the bytewise one walks every byte
+// and skips a byte after each backslash. Both have to agree on every token
+static
+b32 scanned_tokens_match(String source, usize *string_count)
+{
+  JSON_Scanner scanner = {0};
+  JSON_Parser scanned  = { .source = source, .scanner = &scanner };
+  JSON_Parser bytewise = { .source = source };
+
+  b32 result = true;
+  *string_count = 0;
+  while (result)
+  {
+    JSON_Token a = get_json_token(&scanned);
+    JSON_Token b = get_json_token_bytewise(&bytewise);
+
+    result = a.type == b.type && string_match(a.value, b.value) && !scanned.had_error && !bytewise.had_error;
+    *string_count += b.type == JSON_TOKEN_STRING;
+
+    if (b.type == JSON_TOKEN_EOF)
+    {
+      break;
+    }
+  }
+
+  return result;
+}
+
+// Builds ["aaa...\\\\",1] with the backslash run starting at the given offset. An odd run escapes the
+// quote after it, so the string gets an extra x" to close it
+static
+String make_backslash_run_document(u8 *buffer, usize padding, usize run)
+{
+  usize count = 0;
+  buffer[count++] = '[';
+  buffer[count++] = '"';
+  for EACH_INDEX(i, padding) { buffer[count++] = 'a'; }
+  for EACH_INDEX(i, run)     { buffer[count++] = '\\'; }
+  buffer[count++] = '"';
+  if (run & 1)
+  {
+    buffer[count++] = 'x';
+    buffer[count++] = '"';
+  }
+  buffer[count++] = ',';
+  buffer[count++] = '1';
+  buffer[count++] = ']';
+
+  return (String){ .v = buffer, .count = count };
+}
+
+// [0,1,2,...] or {"items":[0,1,2,...],"count":N}, the tape gets count + 1 or count + 5 entries
+static
+String make_items_document(Arena *arena, usize count, b32 in_object)
+{
+  usize capacity = 64 + count * 12;
+  u8 *buffer = (u8 *)arena_alloc(arena, capacity, 1);
+
+  usize at = 0;
+  if (in_object)
+  {
+    at += snprintf((char *)buffer + at, capacity - at, "{\"items\":");
+  }
+  buffer[at++] = '[';
+  for EACH_INDEX(i, count)
+  {
+    at += snprintf((char *)buffer + at, capacity - at, i ? ",%lu" : "%lu", i);
+  }
+  buffer[at++] = ']';
+  if (in_object)
+  {
+    at += snprintf((char *)buffer + at, capacity - at, ",\"count\":%lu}", count);
+  }
+
+  return (String){ .v = buffer, .count = at };
+}
+
+// Walks both side by side, keys, leaf values, and child counts all have to agree
+static
+b32 tape_matches_tree(JSON_Cursor cursor, JSON_Object *object)
+{
+  if (!json_cursor_valid(cursor) || !object)
+  {
+    return !json_cursor_valid(cursor) && !object;
+  }
+
+  b32 result = string_match(json_cursor_key(cursor), object->key);
+
+  if (json_token_type_is_value_type(cursor.tape->entries[cursor.index].type))
+  {
+    result &= string_match(json_cursor_value(cursor), object->value);
+  }
+
+  u32 child_count = 0;
+  JSON_Cursor child_cursor = json_cursor_first_child(cursor);
+  JSON_Object *child = object->first_child;
+  for (; result && json_cursor_valid(child_cursor) && child; child_cursor = json_cursor_next_sibling(child_cursor), child = child->next_sibling)
+  {
+    result &= tape_matches_tree(child_cursor, child);
+    child_count += 1;
+  }
+  result &= !json_cursor_valid(child_cursor) && !child;
+  result &= child_count == json_cursor_child_count(cursor);
+
+  return result;
+}
+
+// Streamed events copied out, keys and values point into reader buffers that get reused
+typedef struct Recorded_Event Recorded_Event;
+struct Recorded_Event
+{
+  JSON_Event_Type type;
+  String          key;
+  String          value;
+  usize           depth;
+};
+
+#define MAX_RECORDED_EVENTS KB(64)
+#define TEST_STREAM_FILE    "bin/test_json_stream.json"
+
+typedef struct Event_Recorder Event_Recorder;
+struct Event_Recorder
+{
+  Arena          *arena;
+  Recorded_Event *events;
+  usize          count;
+  b32            overflowed;
+};
+
+static
+String copy_string(Arena *arena, String string)
+{
+  String result = {.v = (u8 *)arena_alloc(arena, string.count + 1, 1), .count = string.count};
+  MEM_COPY(result.v, string.v, string.count);
+  return result;
+}
+
+static
+void record_event(Event_Recorder *recorder, JSON_Event_Type type, String key, String value, usize depth)
+{
+  if (recorder->count == MAX_RECORDED_EVENTS)
+  {
+    recorder->overflowed = true;
+    return;
+  }
+
+  Recorded_Event *event = recorder->events + recorder->count++;
+  event->type  = type;
+  event->key   = copy_string(recorder->arena, key);
+  event->value = copy_string(recorder->arena, value);
+  event->depth = depth;
+}
+
+static
+void record_stream_event(JSON_Event *event, void *user_data)
+{
+  String value = event->type == JSON_EVENT_VALUE ? event->value.value : (String){0};
+  record_event((Event_Recorder *)user_data, event->type, event->key, value, event->depth);
+}
+
+// What streaming the same source should produce, in order
+static
+void record_tree_events(Event_Recorder *recorder, JSON_Object *object, usize depth)
+{
+  if (object->first_child || object->value.v[0] == '{' || object->value.v[0] == '[')
+  {
+    b32 is_object = object->value.v[0] == '{';
+    record_event(recorder, is_object ? JSON_EVENT_BEGIN_OBJECT : JSON_EVENT_BEGIN_ARRAY, object->key, (String){0}, depth);
+    for (JSON_Object *child = object->first_child; child; child = child->next_sibling)
+    {
+      record_tree_events(recorder, child, depth + 1);
+    }
+    record_event(recorder, is_object ? JSON_EVENT_CLOSE_OBJECT : JSON_EVENT_CLOSE_ARRAY, (String){0}, (String){0}, depth);
+  }
+  else
+  {
+    record_event(recorder, JSON_EVENT_VALUE, object->key, object->value, depth);
+  }
+}
+
+static
+b32 recorded_events_match(Event_Recorder *a, Event_Recorder *b)
+{
+  b32 result = a->count == b->count && !a->overflowed && !b->overflowed;
+  for (usize i = 0; result && i < a->count; i++)
+  {
+    Recorded_Event *x = a->events + i;
+    Recorded_Event *y = b->events + i;
+    result = x->type == y->type && x->depth == y->depth && string_match(x->key, y->key) && string_match(x->value, y->value);
+  }
+
+  return result;
+}
+
+static
+Event_Recorder make_event_recorder(Arena *arena)
+{
+  Event_Recorder result =
+  {
+    .arena  = arena,
+    .events = arena_calloc(arena, MAX_RECORDED_EVENTS, Recorded_Event),
+  };
+
+  return result;
+}
+
+static
+b32 write_test_file(const char *name, String contents)
+{
+  FILE *file = fopen(name, "wb");
+  if (!file)
+  {
+    return false;
+  }
+
+  usize written = fwrite(contents.v, 1, contents.count, file);
+  fclose(file);
+
+  return written == contents.count;
+}
+
+// [{"name":"xxx...","v":0},...] with long enough names that chunk edges land inside strings
+static
+String make_stream_document(Arena *arena, usize element_count, usize name_length)
+{
+  usize capacity = 16 + element_count * (name_length + 48);
+  u8 *buffer = (u8 *)arena_alloc(arena, capacity, 1);
+
+  usize at = 0;
+  buffer[at++] = '[';
+  for EACH_INDEX(i, element_count)
+  {
+    at += snprintf((char *)buffer + at, capacity - at, "%s{\"name\": \"", i ? ",\n  " : "");
+    for EACH_INDEX(c, name_length)
+    {
+      buffer[at++] = 'a' + (u8)((i + c) % 26);
+    }
+    at += snprintf((char *)buffer + at, capacity - at, "\", \"v\": %lu.5, \"ok\": %s}", i, (i & 1) ? "true" : "null");
+  }
+  buffer[at++] = ']';
+
+  return (String){ .v = buffer, .count = at };
+}
+
+// Outside of any string, even count of unescaped quotes before it. No escapes in the generated documents
+static
+b32 offset_inside_string(String source, usize offset)
+{
+  usize quotes = 0;
+  for (usize i = 0; i < offset && i < source.count; i++)
+  {
+    quotes += source.v[i] == '"';
+  }
+
+  return quotes & 1;
+}
+
+int main(int argc, char **argv)
+{
+  TEST_BLOCK(STR("Escaped bits, short backslash runs straddling a block"))
+  {
+    b32 all_match = true;
+    for (usize run = 1; run <= 9; run++)
+    {
+      for (usize start = JSON_SCAN_BLOCK_BYTES - 10; start <= JSON_SCAN_BLOCK_BYTES + 1; start++)
+      {
+        u8 bytes[TEST_JSON_BUFFER_SIZE];
+        MEM_SET(bytes, sizeof(bytes), 'a');
+        MEM_SET(bytes + start, run, '\\');
+        bytes[start + run] = '"';
+
+        all_match &= escaped_blocks_match(bytes, sizeof(bytes));
+      }
+    }
+    TEST_EVAL(all_match);
+  }
+
+  TEST_BLOCK(STR("Escaped bits, runs as long as a block or more"))
+  {
+    usize runs[] = { 63, 64, 65, 127, 128, 129 };
+    b32 all_match = true;
+    for EACH_INDEX(i, STATIC_COUNT(runs))
+    {
+      for (usize start = 0; start <= 2; start++)
+      {
+        u8 bytes[TEST_JSON_BUFFER_SIZE];
+        MEM_SET(bytes, sizeof(bytes), 'a');
+        MEM_SET(bytes + start, runs[i], '\\');
+        bytes[start + runs[i]] = '"';
+
+        all_match &= escaped_blocks_match(bytes, sizeof(bytes));
+      }
+    }
+    TEST_EVAL(all_match);
+  }
+
+  TEST_BLOCK(STR("Escaped bits, alternating runs of odd and even length"))
+  {
+    // \" \\" \\\" \\\\" ... back to back, so the runs land on both odd and even bits and across both block edges
+    u8 bytes[TEST_JSON_BUFFER_SIZE];
+    MEM_SET(bytes, sizeof(bytes), 'a');
+    usize at = 0;
+    for (usize run = 1; at + run + 1 < sizeof(bytes); run = run % 7 + 1)
+    {
+      MEM_SET(bytes + at, run, '\\');
+      at += run;
+      bytes[at++] = '"';
+    }
+    TEST_EVAL(escaped_blocks_match(bytes, sizeof(bytes)));
+  }
+
+  TEST_BLOCK(STR("Escaped quotes, scanner against bytewise tokens"))
+  {
+    u8 buffer[TEST_JSON_BUFFER_SIZE];
+    usize string_count = 0;
+
+    TEST_EVAL(scanned_tokens_match(STR("[\"a\\\"b\", \"c\"]"), &string_count));
+    TEST_EVAL(string_count == 2);
+
+    TEST_EVAL(scanned_tokens_match(STR("{\"key\\\\\": \"value\\\\\\\"\"}"), &string_count));
+    TEST_EVAL(string_count == 2);
+
+    b32 all_match = true;
+    b32 all_counted = true;
+    for (usize run = 1; run <= 8; run++)
+    {
+      for (usize padding = JSON_SCAN_BLOCK_BYTES - 12; padding <= JSON_SCAN_BLOCK_BYTES + 2; padding++)
+      {
+        String document = make_backslash_run_document(buffer, padding, run);
+        all_match   &= scanned_tokens_match(document, &string_count);
+        all_counted &= string_count == 1;
+      }
+    }
+    TEST_EVAL(all_match);
+    TEST_EVAL(all_counted);
+  }
+
+  TEST_BLOCK(STR("Scanner positions, avx2 against scalar"))
+  {
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("bmi") && __builtin_cpu_supports("popcnt"))
+    {
+      u8 buffer[TEST_JSON_BUFFER_SIZE];
+
+      b32 all_match = true;
+      for (usize run = 1; run <= 8; run++)
+      {
+        for (usize padding = JSON_SCAN_BLOCK_BYTES - 12; padding <= JSON_SCAN_BLOCK_BYTES + 2; padding++)
+        {
+          String document = make_backslash_run_document(buffer, padding, run);
+
+          JSON_Scanner scalar = {0};
+          JSON_Scanner avx2   = {0};
+          json_scan_batch_scalar(&scalar, document);
+          json_scan_batch_avx2(&avx2, document);
+
+          all_match &= scalar.count == avx2.count;
+          for (usize i = 0; all_match && i < scalar.count; i++)
+          {
+            all_match &= scalar.positions[i] == avx2.positions[i];
+          }
+        }
+      }
+      TEST_EVAL(all_match);
+    }
+    else
+    {
+      printf("  No AVX2, skipping\n");
+      TEST_EVAL(true);
+    }
+  }
+
+  TEST_BLOCK(STR("Key index only on wide objects"))
+  {
+    Arena arena = arena_make();
+
+    TEST_EVAL(sizeof(JSON_Object) == 48);
+
+    String source = STR("{\"a\": 0, \"b\": 1, \"c\": 2, \"d\": 3, \"e\": 4, \"f\": 5, \"g\": 6, \"h\": 7,"
+                        " \"i\": 8, \"j\": 9, \"k\": 10, \"l\": 11, \"m\": 12, \"n\": 13, \"o\": 14, \"p\": 15,"
+                        " \"q\": 16, \"a\": 17, \"narrow\": {\"x\": 1}, \"list\": [1, 2, 3]}");
+    JSON_Object *root = parse_json(&arena, source, JSON_PARSE_INDEX_KEYS);
+
+    TEST_EVAL(json_key_index(root) != NULL);
+    TEST_EVAL(json_key_index(lookup_json_object(root, STR("narrow"))) == NULL);
+    TEST_EVAL(json_key_index(lookup_json_object(root, STR("list"))) == NULL);
+    TEST_EVAL(json_key_index(lookup_json_object(root, STR("q"))) == NULL);
+
+    TEST_EVAL(json_object_to_f64(lookup_json_object(root, STR("a"))) == 0.0); // First duplicate wins
+    TEST_EVAL(json_object_to_f64(lookup_json_object(root, STR("p"))) == 15.0);
+    TEST_EVAL(json_object_to_f64(lookup_json_object(lookup_json_object(root, STR("narrow")), STR("x"))) == 1.0);
+    TEST_EVAL(lookup_json_object(root, STR("missing")) == NULL);
+
+    arena_free(&arena);
+  }
+
+  TEST_BLOCK(STR("Tape against tree, entry counts around a grow boundary"))
+  {
+    // Separate arenas, the tape has to stay contiguous in its own
+    Arena source_arena = arena_make();
+    Arena tape_arena   = arena_make();
+    Arena tree_arena   = arena_make();
+
+    usize element_counts[] = { JSON_TAPE_GROW - 2, JSON_TAPE_GROW - 1, JSON_TAPE_GROW };
+    for EACH_INDEX(i, STATIC_COUNT(element_counts))
+    {
+      String source = make_items_document(&source_arena, element_counts[i], false);
+
+      JSON_Tape tape = parse_json_tape(&tape_arena, source);
+      JSON_Object *tree = parse_json(&tree_arena, source, JSON_PARSE_NONE);
+      JSON_Cursor root = json_tape_root(&tape);
+
+      TEST_EVAL(tape.count == element_counts[i] + 1);
+      TEST_EVAL(json_cursor_child_count(root) == element_counts[i]);
+      TEST_EVAL(tape_matches_tree(root, tree));
+
+      arena_clear(&source_arena);
+      arena_clear(&tape_arena);
+      arena_clear(&tree_arena);
+    }
+
+    // Exactly JSON_TAPE_GROW entries with keys to look up
+    {
+      usize element_count = JSON_TAPE_GROW - 5;
+      String source = make_items_document(&source_arena, element_count, true);
+
+      JSON_Tape tape = parse_json_tape(&tape_arena, source);
+      JSON_Object *tree = parse_json(&tree_arena, source, JSON_PARSE_NONE);
+      JSON_Cursor root = json_tape_root(&tape);
+
+      TEST_EVAL(tape.count == JSON_TAPE_GROW);
+      TEST_EVAL(tape_matches_tree(root, tree));
+
+      JSON_Cursor items = lookup_json_cursor(root, STR("items"));
+      TEST_EVAL(json_cursor_child_count(items) == element_count);
+      TEST_EVAL(json_cursor_to_f64(lookup_json_cursor(root, STR("count"))) ==
+                json_object_to_f64(lookup_json_object(tree, STR("count"))));
+      TEST_EVAL(!json_cursor_valid(lookup_json_cursor(root, STR("missing"))));
+      TEST_EVAL(!json_cursor_valid(lookup_json_cursor(items, STR("items")))); // Arrays have no keys
+    }
+
+    arena_free(&source_arena);
+    arena_free(&tape_arena);
+    arena_free(&tree_arena);
+  }
+
+  TEST_BLOCK(STR("Streaming events against the tree"))
+  {
+    Arena arena = arena_make();
+
+    String source = STR("{\"a\": 1, \"list\": [1, \"two\", [], {\"x\": null}], \"b\": {\"c\": true, \"d\": false}, \"e\": \"q\\\"uote\"}");
+
+    Event_Recorder expected = make_event_recorder(&arena);
+    record_tree_events(&expected, parse_json(&arena, source, JSON_PARSE_NONE), 0);
+
+    Event_Recorder streamed = make_event_recorder(&arena);
+    TEST_EVAL(stream_json(source, record_stream_event, &streamed));
+    TEST_EVAL(recorded_events_match(&streamed, &expected));
+
+    // Same through the reader thread
+    Event_Recorder from_file = make_event_recorder(&arena);
+    TEST_EVAL(write_test_file(TEST_STREAM_FILE, source));
+    TEST_EVAL(stream_json_file(String(TEST_STREAM_FILE), 0, record_stream_event, &from_file, NULL));
+    TEST_EVAL(recorded_events_match(&from_file, &expected));
+
+    remove(TEST_STREAM_FILE);
+    arena_free(&arena);
+  }
+
+  TEST_BLOCK(STR("Streaming a file over many small chunks"))
+  {
+    Arena arena = arena_make();
+
+    // Smallest chunk the reader allows is the look ahead, so this is several chunks with strings over each edge
+    String source = make_stream_document(&arena, 600, 1000);
+    usize chunk_size = JSON_READER_LOOKAHEAD;
+
+    b32 straddles = false;
+    for (usize edge = chunk_size; edge < source.count; edge += chunk_size)
+    {
+      straddles |= offset_inside_string(source, edge);
+    }
+    TEST_EVAL(source.count > 4 * chunk_size);
+    TEST_EVAL(straddles);
+
+    Event_Recorder expected = make_event_recorder(&arena);
+    record_tree_events(&expected, parse_json(&arena, source, JSON_PARSE_NONE), 0);
+
+    Event_Recorder from_file = make_event_recorder(&arena);
+    JSON_Reader_Stats stats = {0};
+    TEST_EVAL(write_test_file(TEST_STREAM_FILE, source));
+    TEST_EVAL(stream_json_file(String(TEST_STREAM_FILE), 1, record_stream_event, &from_file, &stats));
+    TEST_EVAL(recorded_events_match(&from_file, &expected));
+    TEST_EVAL(stats.bytes_read == source.count);
+    TEST_EVAL(stats.chunk_count == (source.count + chunk_size - 1) / chunk_size);
+
+    remove(TEST_STREAM_FILE);
+    arena_free(&arena);
+  }
+
+  TEST_BLOCK(STR("Streaming tokens and white space against the look ahead"))
+  {
+    Arena arena = arena_make();
+
+    // A string just under the look ahead, starting right before the first chunk edge after a long run of
+    // white space, still has to come through whole
+    usize long_count = JSON_READER_LOOKAHEAD - 16;
+    usize lead_count = JSON_READER_LOOKAHEAD + KB(8) - 10; // Longer than the look ahead, and ends just before the edge
+    u8 *buffer = (u8 *)arena_alloc(&arena, lead_count + long_count + 16, 1);
+    usize at = 0;
+    buffer[at++] = '[';
+    MEM_SET(buffer + at, lead_count, ' ');
+    at += lead_count;
+    buffer[at++] = '"';
+    MEM_SET(buffer + at, long_count, 'x');
+    at += long_count;
+    buffer[at++] = '"';
+    buffer[at++] = ']';
+    String source = {.v = buffer, .count = at};
+
+    Event_Recorder expected = make_event_recorder(&arena);
+    record_tree_events(&expected, parse_json(&arena, source, JSON_PARSE_NONE), 0);
+
+    Event_Recorder from_file = make_event_recorder(&arena);
+    TEST_EVAL(write_test_file(TEST_STREAM_FILE, source));
+    TEST_EVAL(stream_json_file(String(TEST_STREAM_FILE), 1, record_stream_event, &from_file, NULL));
+    TEST_EVAL(recorded_events_match(&from_file, &expected));
+    TEST_EVAL(from_file.count == 3 && from_file.events[1].value.count == long_count);
+
+    // Longer than the look ahead plus a whole chunk can't be carried over wherever it starts, has to be an
+    // error rather than a split token
+    usize too_long_count = 3 * JSON_READER_LOOKAHEAD;
+    u8 *too_long = (u8 *)arena_alloc(&arena, too_long_count + 16, 1);
+    at = 0;
+    too_long[at++] = '[';
+    too_long[at++] = '"';
+    MEM_SET(too_long + at, too_long_count, 'y');
+    at += too_long_count;
+    too_long[at++] = '"';
+    too_long[at++] = ']';
+
+    Event_Recorder cut = make_event_recorder(&arena);
+    TEST_EVAL(write_test_file(TEST_STREAM_FILE, (String){.v = too_long, .count = at}));
+    TEST_EVAL(!stream_json_file(String(TEST_STREAM_FILE), 1, record_stream_event, &cut, NULL));
+
+    b32 any_value = false;
+    for (usize i = 0; i < cut.count; i++)
+    {
+      any_value |= cut.events[i].type == JSON_EVENT_VALUE;
+    }
+    TEST_EVAL(!any_value);
+
+    remove(TEST_STREAM_FILE);
+    arena_free(&arena);
+  }
+
+  TEST_BLOCK(STR("Streaming an empty file"))
+  {
+    Arena arena = arena_make();
+
+    Event_Recorder from_file = make_event_recorder(&arena);
+    TEST_EVAL(write_test_file(TEST_STREAM_FILE, (String){0}));
+    TEST_EVAL(!stream_json_file(String(TEST_STREAM_FILE), 1, record_stream_event, &from_file, NULL));
+    TEST_EVAL(from_file.count == 0);
+
+    Event_Recorder from_memory = make_event_recorder(&arena);
+    TEST_EVAL(!stream_json((String){0}, record_stream_event, &from_memory));
+    TEST_EVAL(from_memory.count == 0);
+
+    TEST_EVAL(!stream_json_file(String("bin/does_not_exist.json"), 1, record_stream_event, &from_file, NULL));
+
+    remove(TEST_STREAM_FILE);
+    arena_free(&arena);
+  }
+
+  tester_summarize();
+}